@@ -1,6 +1,7 @@
 #pragma once
 #include <assert.h>
 #include <bitset>
+#include <cstring>
 #include <map>
 #include <stdint.h>
 #include <vector>
@@ -41,6 +42,19 @@ namespace srrg_hbst {
     static constexpr uint32_t descriptor_size_bits_overflow =
       descriptor_size_bits - descriptor_size_bits_in_bytes;
 
+    //! @brief number of 64-bit words occupied by the descriptor (unused trailing bits are zero)
+    static constexpr uint32_t descriptor_size_words = (descriptor_size_bits_ + 63) / 64;
+
+    //! @brief true if the descriptor is stored as a plain array of machine words (bit i in word
+    //! i/64 for 64-bit words) without padding - word-wise access copies the words out of the
+    //! descriptor, other standard libraries fall back to the bitset interface
+#if defined(__GLIBCXX__) || defined(_LIBCPP_VERSION)
+    static constexpr bool is_word_layout =
+      sizeof(Descriptor) == descriptor_size_words * sizeof(uint64_t);
+#else
+    static constexpr bool is_word_layout = false;
+#endif
+
     // ds ctor/dtor
   public:
     //! @brief default constructor: DISABLED
@@ -104,6 +118,83 @@ namespace srrg_hbst {
       return (matchable_query_->descriptor ^ this->descriptor).count();
     }
 
+    //! @brief computes the Hamming descriptor distance word by word and terminates as soon as the
+    //! accumulated distance exceeds maximum_distance_ (e.g. for thresholded leaf scans)
+    //! @param[in] matchable_query_ the matchable to compare this against
+    //! @param[in] maximum_distance_ the distance bound
+    //! @returns the exact matching distance if it is not greater than maximum_distance_, otherwise
+    //! a partial distance greater than maximum_distance_
+    inline const uint32_t
+    distanceBounded(const BinaryMatchable<ObjectType_, descriptor_size_bits_>* matchable_query_,
+                    const uint32_t& maximum_distance_) const {
+      return distanceBounded(matchable_query_->descriptor, this->descriptor, maximum_distance_);
+    }
+
+    //! @brief bounded Hamming distance between two plain descriptors (see member distanceBounded)
+    //! @param[in] descriptor_query_ the query descriptor
+    //! @param[in] descriptor_reference_ the reference descriptor
+    //! @param[in] maximum_distance_ the distance bound
+    //! @returns the exact matching distance if it is not greater than maximum_distance_, otherwise
+    //! a partial distance greater than maximum_distance_
+    static inline const uint32_t distanceBounded(const Descriptor& descriptor_query_,
+                                                 const Descriptor& descriptor_reference_,
+                                                 const uint32_t& maximum_distance_) {
+      if (!is_word_layout) {
+        return (descriptor_query_ ^ descriptor_reference_).count();
+      }
+      uint32_t distance = 0;
+      for (uint32_t index_word = 0; index_word < descriptor_size_words; ++index_word) {
+        distance += getNumberOfSetBits(getWord(descriptor_query_, index_word) ^
+                                       getWord(descriptor_reference_, index_word));
+        if (distance > maximum_distance_) {
+          break;
+        }
+      }
+      return distance;
+    }
+
+    //! @brief 64-bit sketch of a descriptor: all descriptor words folded by XOR - the Hamming
+    //! distance between two sketches is a lower bound of the distance between their descriptors
+    //! (a differing sketch bit requires at least one differing descriptor bit)
+    //! @param[in] descriptor_ the descriptor
+    //! @returns the descriptor sketch
+    static inline uint64_t getSketch(const Descriptor& descriptor_) {
+      uint64_t sketch = 0;
+      if (!is_word_layout) {
+        for (uint32_t index_bit = 0; index_bit < descriptor_size_bits; ++index_bit) {
+          sketch ^= static_cast<uint64_t>(descriptor_[index_bit]) << (index_bit % 64);
+        }
+        return sketch;
+      }
+      for (uint32_t index_word = 0; index_word < descriptor_size_words; ++index_word) {
+        sketch ^= getWord(descriptor_, index_word);
+      }
+      return sketch;
+    }
+
+    //! @brief 64-bit word of the descriptor storage (requires is_word_layout) - the word is copied
+    //! out of the descriptor bytes instead of aliasing the bitset internals
+    //! @param[in] descriptor_ the descriptor
+    //! @param[in] index_word_ word index, smaller than descriptor_size_words
+    //! @returns the descriptor word (bit i corresponds to descriptor bit 64*index_word_+i)
+    static inline uint64_t getWord(const Descriptor& descriptor_, const uint32_t& index_word_) {
+      uint64_t word;
+      std::memcpy(&word,
+                  reinterpret_cast<const unsigned char*>(&descriptor_) +
+                    index_word_ * sizeof(uint64_t),
+                  sizeof(uint64_t));
+      return word;
+    }
+
+    //! @brief population count of a descriptor word
+    static inline uint32_t getNumberOfSetBits(const uint64_t& word_) {
+#if defined(__GNUC__) || defined(__clang__)
+      return __builtin_popcountll(word_);
+#else
+      return std::bitset<64>(word_).count();
+#endif
+    }
+
 #ifdef SRRG_MERGE_DESCRIPTORS
     //! @brief merges a matchable with THIS matchable (desirable when having to store identical
     //! descriptors)
@@ -140,32 +231,35 @@ namespace srrg_hbst {
       }
     }
 
-#ifdef SRRG_HBST_HAS_OPENCV
-    //! @brief descriptor wrapping - only available if OpenCV is present on building system
-    //! @param[in] descriptor_cv_ opencv descriptor to convert into HBST format
-    static inline Descriptor getDescriptor(const cv::Mat& descriptor_cv_) {
-      // ds buffer
-      Descriptor binary_descriptor(descriptor_size_bits_);
-
-      // ds set original descriptor string after augmentation
-      for (uint64_t byte_index = 0; byte_index < raw_descriptor_size_bytes; ++byte_index) {
-        const uint32_t bit_index_start = byte_index * 8;
-
-        // ds grab a byte and convert it to a bitset so we can access the single bits
-        const std::bitset<8> descriptor_byte(descriptor_cv_.at<uchar>(byte_index));
-
-        // ds set bitstring
-        for (uint8_t v = 0; v < 8; ++v) {
-          binary_descriptor[bit_index_start + v] = descriptor_byte[v];
+    //! @brief descriptor conversion from a raw byte string (e.g. a row of an ORB descriptor buffer)
+    //! bit v of byte b becomes descriptor bit 8*b+v - the bytes are copied at once if the
+    //! descriptor words share the byte order of the string (little-endian word layout)
+    //! @param[in] descriptor_raw_ raw descriptor with at least raw_descriptor_size_bytes bytes
+    //! (plus one byte for descriptor_size_bits_overflow bits)
+    static inline Descriptor getDescriptor(const uint8_t* descriptor_raw_) {
+      Descriptor binary_descriptor;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      const bool is_byte_layout = is_word_layout;
+#else
+      const bool is_byte_layout = false;
+#endif
+      if (is_byte_layout) {
+        std::memcpy(
+          static_cast<void*>(&binary_descriptor), descriptor_raw_, raw_descriptor_size_bytes);
+      } else {
+        // ds set the descriptor byte by byte
+        for (uint32_t byte_index = 0; byte_index < raw_descriptor_size_bytes; ++byte_index) {
+          const std::bitset<8> descriptor_byte(descriptor_raw_[byte_index]);
+          for (uint32_t v = 0; v < 8; ++v) {
+            binary_descriptor[8 * byte_index + v] = descriptor_byte[v];
+          }
         }
       }
 
       // ds check if we have extra bits (less than 1 byte i.e. <= 7 bits)
       if (descriptor_size_bits_overflow > 0) {
-        // ds get last byte (not fully set)
-        const std::bitset<8> descriptor_byte(descriptor_cv_.at<uchar>(raw_descriptor_size_bytes));
-
-        // ds only set the remaining bits
+        // ds get last byte (not fully set) and only set the remaining bits
+        const std::bitset<8> descriptor_byte(descriptor_raw_[raw_descriptor_size_bytes]);
         for (uint32_t v = 0; v < descriptor_size_bits_overflow; ++v) {
           binary_descriptor[descriptor_size_bits_in_bytes + v] =
             descriptor_byte[8 - descriptor_size_bits_overflow + v];
@@ -173,6 +267,13 @@ namespace srrg_hbst {
       }
       return binary_descriptor;
     }
+
+#ifdef SRRG_HBST_HAS_OPENCV
+    //! @brief descriptor wrapping - only available if OpenCV is present on building system
+    //! @param[in] descriptor_cv_ opencv descriptor to convert into HBST format
+    static inline Descriptor getDescriptor(const cv::Mat& descriptor_cv_) {
+      return getDescriptor(descriptor_cv_.ptr<uint8_t>());
+    }
 #endif
 
     // ds attributes
@@ -212,6 +313,10 @@ namespace srrg_hbst {
   template <typename ObjectType_, uint32_t descriptor_size_bits_>
   constexpr uint32_t
     BinaryMatchable<ObjectType_, descriptor_size_bits_>::descriptor_size_bits_overflow;
+  template <typename ObjectType_, uint32_t descriptor_size_bits_>
+  constexpr uint32_t BinaryMatchable<ObjectType_, descriptor_size_bits_>::descriptor_size_words;
+  template <typename ObjectType_, uint32_t descriptor_size_bits_>
+  constexpr bool BinaryMatchable<ObjectType_, descriptor_size_bits_>::is_word_layout;
 
   template <typename ObjectType_>
   using BinaryMatchable128 = BinaryMatchable<ObjectType_, 128>;
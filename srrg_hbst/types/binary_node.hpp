@@ -1,5 +1,7 @@
 #pragma once
+#include <algorithm>
 #include <cmath>
+#include <limits>
 #include <random>
 
 #include "binary_match.hpp"
@@ -21,7 +23,7 @@ namespace srrg_hbst {
     using MatchableVector = std::vector<Matchable*>;
     using Descriptor      = typename Matchable::Descriptor;
     using real_type       = real_type_;
-    using Match           = BinaryMatch<Matchable, real_type>;
+    using Match           = BinaryMatch<Matchable>;
 
     //! @brief header for de/serialization TODO fuse with attributes
     struct Header {
@@ -34,19 +36,96 @@ namespace srrg_hbst {
       uint64_t number_of_matchables_compressed   = 0;
     };
 
+    //! @brief node parameters owned by a tree and shared by all of its nodes - the defaults are
+    //! taken from the static members at construction (see maximum_leaf_size)
+    struct Configuration {
+      //! @brief minimum number of matchables in a node before splitting
+      uint64_t maximum_leaf_size = Node::maximum_leaf_size;
+
+      //! @brief maximum achieved descriptor group partitioning using the index_split_bit
+      real_type maximum_partitioning = Node::maximum_partitioning;
+
+      //! @brief maximum tree depth (leaf spawning blocks if reached)
+      uint32_t maximum_depth = Node::maximum_depth;
+
+      //! @brief whether internal nodes keep the summaries of their subtree (see Summary)
+      bool summarize_internal_nodes = Node::summarize_internal_nodes;
+
+      //! @brief bits eligible for splitting (set by the constructors taking a mask)
+      Descriptor bit_mask = Descriptor().set();
+
+      //! @brief random number generator used for random splitting (seed for a different stream)
+      std::mt19937 random_number_generator;
+    };
+
+    //! @brief bit summaries and image range of all descriptors in a subtree - kept by all leafs
+    //! and by internal nodes only if configured (tighter bounds for exact search and probing)
+    struct Summary {
+      //! @brief bit summaries of all descriptors in this subtree (see getDistanceLowerBound)
+      Descriptor bits_set_in_all = Descriptor().set();
+      Descriptor bits_set_in_any;
+
+      //! @brief image identifier range of this subtree (see getIdentifierImageMinimum)
+      uint64_t identifier_image_minimum = std::numeric_limits<uint64_t>::max();
+      uint64_t identifier_image_maximum = 0;
+    };
+
+    //! @brief attributes only leafs carry - released when a leaf is split, internal nodes keep
+    //! only their split bit, children and optionally a Summary
+    struct LeafStorage : public Summary {
+      LeafStorage(Configuration* configuration_,
+                  const uint64_t& depth_,
+                  const MatchableVector& matchables_) :
+        configuration(configuration_),
+        header(depth_),
+        matchables(matchables_) {
+      }
+
+      //! @brief configuration shared by all nodes of the tree (owned by the tree)
+      Configuration* configuration;
+
+      //! @brief serializable header carrying core attributes
+      Header header;
+
+      //! @brief matchables contained in this leaf
+      MatchableVector matchables;
+
+      //! @brief sketch of each matchable in this leaf (same order)
+      std::vector<uint64_t> sketches;
+    };
+
     // ds ctor/dtor
   public:
-    // ds access only through this constructor: no mask provided
+    // ds access only through this constructor: no mask provided (the root owns a configuration
+    // initialized from the static defaults)
     BinaryNode(const MatchableVector& matchables_,
                const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) :
-      Node(nullptr, 0, matchables_, Descriptor().set(), train_mode_) {
+      Node(new Configuration(), matchables_, train_mode_) {
+      owns_configuration = true;
     }
 
-    // ds access only through this constructor: mask provided
+    // ds access only through this constructor: mask provided (kept in the owned configuration)
     BinaryNode(const MatchableVector& matchables_,
                Descriptor bit_mask_,
                const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) :
-      Node(nullptr, 0, matchables_, bit_mask_, train_mode_) {
+      Node(new Configuration(), matchables_, bit_mask_, train_mode_) {
+      owns_configuration = true;
+    }
+
+    // ds access only through this constructor: configuration (of a tree) provided, no mask
+    BinaryNode(Configuration* configuration_,
+               const MatchableVector& matchables_,
+               const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) :
+      Node(configuration_, nullptr, 0, matchables_, train_mode_) {
+    }
+
+    // ds access only through this constructor: configuration (of a tree) and mask provided - the
+    // mask is kept in the configuration, all nodes sharing it derive their mask from it
+    BinaryNode(Configuration* configuration_,
+               const MatchableVector& matchables_,
+               Descriptor bit_mask_,
+               const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) :
+      Node(_setBitMask(configuration_, bit_mask_), nullptr, 0, matchables_, train_mode_) {
     }
 
     // ds the default constructor is triggered by subclasses - the responsibility of attribute
@@ -55,10 +134,21 @@ namespace srrg_hbst {
     BinaryNode() {
     }
 
+    // ds nodes own their children and summary
+    BinaryNode(const Node&) = delete;
+    Node& operator=(const Node&) = delete;
+
     // ds destructor: recursive destruction of child nodes (risky but readable)
     virtual ~BinaryNode() {
+      const Configuration* configuration_owned = owns_configuration ? _getConfiguration() : nullptr;
       delete left;
       delete right;
+      if (has_leafs) {
+        delete summary;
+      } else {
+        delete _getStorage();
+      }
+      delete configuration_owned;
     }
 
     // ds access
@@ -66,22 +156,31 @@ namespace srrg_hbst {
     // ds create leafs (external use intented)
     virtual const bool spawnLeafs(const SplittingStrategy& train_mode_) {
       assert(!has_leafs);
-      _header.number_of_matchables_compressed = matchables.size();
+      LeafStorage* storage = _getStorage();
+      assert(storage);
+      assert(storage->configuration);
+      const Configuration& configuration = *storage->configuration;
+      const MatchableVector& matchables  = storage->matchables;
+      Header& header                     = storage->header;
+
+      // ds synchronize the number of stored matchables
+      header.number_of_matchables_compressed = matchables.size();
 
       // ds exit if maximum depth is reached
-      if (_header.depth == maximum_depth) {
+      if (header.depth == configuration.maximum_depth) {
         return false;
       }
 
       // ds exit if we have insufficient data
-      if (_header.number_of_matchables_uncompressed < maximum_leaf_size) {
+      if (header.number_of_matchables_uncompressed < configuration.maximum_leaf_size) {
         return false;
       }
 
       // ds affirm initial situation
-      index_split_bit         = -1;
-      number_of_on_bits_total = 0;
-      partitioning            = maximum_partitioning;
+      index_split_bit                  = -1;
+      uint64_t number_of_on_bits_total = 0;
+      real_type partitioning           = configuration.maximum_partitioning;
+      const Descriptor bit_mask        = getBitMask();
 
       // ds for balanced splitting
       switch (train_mode_) {
@@ -154,7 +253,8 @@ namespace srrg_hbst {
             std::uniform_int_distribution<uint32_t> available_indices(0, available_bits.size() - 1);
 
             // ds sample uniformly at random
-            index_split_bit = available_bits[available_indices(Node::random_number_generator)];
+            index_split_bit =
+              available_bits[available_indices(storage->configuration->random_number_generator)];
 
             // ds compute distance for this index (0.0 is perfect)
             partitioning = std::fabs(
@@ -166,13 +266,7 @@ namespace srrg_hbst {
       }
 
       // ds if best was found and the partitioning is sufficient (0 to 0.5) - we can spawn leaves
-      if (index_split_bit != -1 && partitioning < maximum_partitioning) {
-        // ds get a mask copy
-        Descriptor bit_mask_previous(bit_mask);
-
-        // ds update mask for leafs
-        bit_mask_previous[index_split_bit] = 0;
-
+      if (index_split_bit != -1 && partitioning < configuration.maximum_partitioning) {
         // ds first we have to split the descriptors by the found index - preallocate vectors since
         // we know how many ones we have
         MatchableVector matchables_ones(number_of_on_bits_total);
@@ -193,17 +287,22 @@ namespace srrg_hbst {
         assert(matchables_ones.size() == index_ones);
         assert(matchables_zeros.size() == index_zeros);
 
-        // ds this leaf becomes a regular node and hence does not carry matchables
+        // ds this leaf becomes a regular node and hence does not carry leaf attributes - it
+        // keeps a copy of its summary only if configured
+        Configuration* configuration_leafs = storage->configuration;
+        const uint64_t depth_leafs         = header.depth + 1;
+        Summary* summary_internal =
+          configuration.summarize_internal_nodes ? new Summary(*storage) : nullptr;
+        delete storage;
+        summary   = summary_internal;
         has_leafs = true;
-        matchables.clear();
-        _header.number_of_matchables_compressed = 0;
 
         // ds if there are elements for leaves
         assert(0 < matchables_ones.size());
-        right = new Node(this, _header.depth + 1, matchables_ones, bit_mask_previous, train_mode_);
+        right = new Node(configuration_leafs, this, depth_leafs, matchables_ones, train_mode_);
 
         assert(0 < matchables_zeros.size());
-        left = new Node(this, _header.depth + 1, matchables_zeros, bit_mask_previous, train_mode_);
+        left = new Node(configuration_leafs, this, depth_leafs, matchables_zeros, train_mode_);
 
         // ds success
         return true;
@@ -215,55 +314,177 @@ namespace srrg_hbst {
 
     // ds getters
   public:
+    //! @brief matchables contained in this node (empty for internal nodes)
     const MatchableVector& getMatchables() const {
-      return matchables;
+      return _getStorage() ? _getStorage()->matchables : _getMatchablesEmpty();
     }
-    const uint64_t& getDepth() const {
-      return _header.depth;
+
+    //! @brief depth of this node (internal nodes: number of parents)
+    const uint64_t getDepth() const {
+      if (_getStorage()) {
+        return _getStorage()->header.depth;
+      }
+      uint64_t depth = 0;
+      for (const Node* node = parent; node; node = node->parent) {
+        ++depth;
+      }
+      return depth;
     }
     const int32_t& indexSplitBit() const {
       return index_split_bit;
     }
-    const uint64_t& getNumberOfSetBits() const {
-      return number_of_on_bits_total;
+
+    //! @brief bit splitting mask of this node: bits eligible for splitting (see Configuration)
+    //! and not split on the path from the root
+    const Descriptor getBitMask() const {
+      const Configuration* configuration = _getConfiguration();
+      Descriptor bit_mask = configuration ? configuration->bit_mask : Descriptor().set();
+      for (const Node* node = parent; node; node = node->parent) {
+        bit_mask[node->index_split_bit] = 0;
+      }
+      return bit_mask;
     }
     const bool& hasLeafs() const {
       return has_leafs;
     }
 
+    //! @brief checks whether this node keeps a summary of its subtree (leafs always do)
+    const bool hasSummary() const {
+      return summary != nullptr;
+    }
+
+    //! @brief lower bound of the distance between a descriptor and any descriptor in this subtree:
+    //! bits set in all subtree descriptors but not in descriptor_ plus bits set in descriptor_
+    //! but in no subtree descriptor (permits rejecting the subtree without a distance evaluation)
+    //! @param[in] descriptor_ query descriptor
+    //! @returns distance lower bound (0 for internal nodes without summary)
+    const uint32_t getDistanceLowerBound(const Descriptor& descriptor_) const {
+      if (!summary) {
+        return 0;
+      }
+      return ((summary->bits_set_in_all & ~descriptor_) | (descriptor_ & ~summary->bits_set_in_any))
+        .count();
+    }
+
+    //! @brief sketches of the matchables in this node (see BinaryMatchable::getSketch), stored
+    //! contiguously for a cheap first stage of leaf scans
+    const std::vector<uint64_t>& getSketches() const {
+      return _getStorage() ? _getStorage()->sketches : _getSketchesEmpty();
+    }
+
+    //! @brief adds a matchable to this leaf, keeping its sketch
+    //! @param[in] matchable_ matchable to add
+    void addMatchable(Matchable* matchable_) {
+      LeafStorage* storage = _getStorage();
+      assert(storage);
+      storage->matchables.push_back(matchable_);
+      storage->sketches.push_back(Matchable::getSketch(matchable_->descriptor));
+    }
+
+    //! @brief includes a descriptor added to this subtree in the bit summaries
+    //! @param[in] descriptor_ added descriptor
+    void updateBitSummaries(const Descriptor& descriptor_) {
+      if (summary) {
+        summary->bits_set_in_all &= descriptor_;
+        summary->bits_set_in_any |= descriptor_;
+      }
+    }
+
+    //! @brief range of the image identifiers referenced in this subtree (empty range: minimum
+    //! above maximum, full range for internal nodes without summary) - permits skipping subtrees
+    //! without images of interest
+    const uint64_t getIdentifierImageMinimum() const {
+      return summary ? summary->identifier_image_minimum : 0;
+    }
+    const uint64_t getIdentifierImageMaximum() const {
+      return summary ? summary->identifier_image_maximum : std::numeric_limits<uint64_t>::max();
+    }
+
+    //! @brief includes an image referenced in this subtree in the image range
+    //! @param[in] identifier_image_ image identifier
+    void updateImageRange(const uint64_t& identifier_image_) {
+      if (summary) {
+        summary->identifier_image_minimum =
+          std::min(summary->identifier_image_minimum, identifier_image_);
+        summary->identifier_image_maximum =
+          std::max(summary->identifier_image_maximum, identifier_image_);
+      }
+    }
+
     // ds inner constructors (used for recursive tree building)
   protected:
     // ds only internally called: default for single matchables
-    BinaryNode(Node* parent_,
+    BinaryNode(Configuration* configuration_,
+               Node* parent_,
                const uint64_t& depth_,
                const MatchableVector& matchables_,
-               Descriptor bit_mask_,
                const SplittingStrategy& train_mode_) :
       parent(parent_),
-      _header(depth_),
-      matchables(matchables_),
-      bit_mask(bit_mask_) {
+      summary(new LeafStorage(configuration_, depth_, matchables_)) {
+      LeafStorage* storage = _getStorage();
 #ifdef SRRG_MERGE_DESCRIPTORS
       // ds recompute current number of contained merged matchables TODO make this less horribly
       // wasteful
-      _header.number_of_matchables_uncompressed = 0;
-      for (const Matchable* matchable : matchables) {
-        _header.number_of_matchables_uncompressed += matchable->number_of_objects;
+      storage->header.number_of_matchables_uncompressed = 0;
+      for (const Matchable* matchable : matchables_) {
+        storage->header.number_of_matchables_uncompressed += matchable->number_of_objects;
       }
 #else
-      _header.number_of_matchables_uncompressed = matchables.size();
+      storage->header.number_of_matchables_uncompressed = matchables_.size();
 #endif
+      storage->sketches.reserve(matchables_.size());
+      for (const Matchable* matchable : matchables_) {
+        updateBitSummaries(matchable->descriptor);
+        storage->sketches.push_back(Matchable::getSketch(matchable->descriptor));
+        for (const typename Matchable::ObjectMap::value_type& object : matchable->objects) {
+          updateImageRange(object.first);
+        }
+      }
       spawnLeafs(train_mode_);
     }
 
     // ds helpers
   protected:
+    //! @brief configuration shared by the nodes of this tree (kept in the leaf storages)
+    const Configuration* _getConfiguration() const {
+      const Node* leaf = this;
+      while (leaf->has_leafs) {
+        leaf = leaf->left;
+      }
+      return leaf->_getStorage() ? leaf->_getStorage()->configuration : nullptr;
+    }
+
+    //! @brief sets the bits eligible for splitting of all nodes sharing a configuration
+    static Configuration* _setBitMask(Configuration* configuration_, const Descriptor& bit_mask_) {
+      configuration_->bit_mask = bit_mask_;
+      return configuration_;
+    }
+
+    //! @brief leaf attributes (nullptr for internal nodes, see LeafStorage)
+    LeafStorage* _getStorage() {
+      return has_leafs ? nullptr : static_cast<LeafStorage*>(summary);
+    }
+    const LeafStorage* _getStorage() const {
+      return has_leafs ? nullptr : static_cast<const LeafStorage*>(summary);
+    }
+
+    //! @brief empty leaf attributes returned for internal nodes
+    static const MatchableVector& _getMatchablesEmpty() {
+      static const MatchableVector matchables_empty;
+      return matchables_empty;
+    }
+    static const std::vector<uint64_t>& _getSketchesEmpty() {
+      static const std::vector<uint64_t> sketches_empty;
+      return sketches_empty;
+    }
+
     const real_type _getSetBitFraction(const uint32_t& index_split_bit_,
                                        const MatchableVector& matchables_,
                                        uint64_t& number_of_set_bits_total_) const {
+      const LeafStorage* storage = _getStorage();
       assert(0 < matchables_.size());
-      assert(0 < _header.number_of_matchables_uncompressed);
-      assert(matchables_.size() <= _header.number_of_matchables_uncompressed);
+      assert(0 < storage->header.number_of_matchables_uncompressed);
+      assert(matchables_.size() <= storage->header.number_of_matchables_uncompressed);
 
       // ds count set bits of all matchables in this node
       uint64_t number_of_set_bits = 0;
@@ -288,11 +509,11 @@ namespace srrg_hbst {
       }
       number_of_set_bits_total_ = number_of_set_bits;
 #endif
-      assert(number_of_set_bits <= _header.number_of_matchables_uncompressed);
+      assert(number_of_set_bits <= storage->header.number_of_matchables_uncompressed);
 
       // ds return ratio
       return (static_cast<real_type>(number_of_set_bits) /
-              _header.number_of_matchables_uncompressed);
+              storage->header.number_of_matchables_uncompressed);
     }
 
     // ds public fields
@@ -306,40 +527,32 @@ namespace srrg_hbst {
     //! @brief parent node (if any, for root:parent=0)
     Node* parent = nullptr;
 
-    //! @brief minimum number of matchables in a node before splitting
+    //! @brief default minimum number of matchables in a node before splitting (see Configuration)
     static uint64_t maximum_leaf_size;
 
-    //! @brief maximum achieved descriptor group partitioning using the index_split_bit
+    //! @brief default maximum achieved descriptor group partitioning (see Configuration)
     static real_type maximum_partitioning;
 
-    //! @brief maximum tree depth (leaf spawning blocks if reached, default: descriptor dimension)
+    //! @brief default maximum tree depth (see Configuration, default: descriptor dimension)
     static uint32_t maximum_depth;
 
+    //! @brief default whether internal nodes keep subtree summaries (see Configuration)
+    static bool summarize_internal_nodes;
+
     // ds fields
   protected:
-    //! @brief serializable header carrying core attributes
-    Header _header;
-
-    //! @brief matchables contained in this node
-    MatchableVector matchables;
+    //! @brief owned summary: the LeafStorage of a leaf or the (optional) Summary of an internal
+    //! node - a single pointer keeps internal nodes compact
+    Summary* summary = nullptr;
 
     //! @brief the split bit diving potential leafs of this node
     int32_t index_split_bit = -1;
 
-    //! @brief number of bits with value on
-    uint64_t number_of_on_bits_total = 0;
-
     //! @brief flag set if the current node has 2 leafs
     bool has_leafs = false;
 
-    //! @brief achieved descriptor group partitioning using the index_split_bit
-    real_type partitioning = 1;
-
-    //! @brief bit splitting mask considered before choosing index_split_bit
-    Descriptor bit_mask;
-
-    // ds random number generator, used for random splitting (for all nodes)
-    static std::mt19937 random_number_generator;
+    //! @brief flag set for roots built without a tree: the configuration is released with them
+    bool owns_configuration = false;
 
     //! @brief allow direct access for processing classes
     template <typename BinaryNodeType_>
@@ -355,7 +568,7 @@ namespace srrg_hbst {
   uint32_t BinaryNode<BinaryMatchableType_, real_type_>::maximum_depth =
     BinaryMatchableType_::descriptor_size_bits;
   template <typename BinaryMatchableType_, typename real_type_>
-  std::mt19937 BinaryNode<BinaryMatchableType_, real_type_>::random_number_generator;
+  bool BinaryNode<BinaryMatchableType_, real_type_>::summarize_internal_nodes = false;
 
   template <typename ObjectType_>
   using BinaryNode128 = BinaryNode<BinaryMatchable128<ObjectType_>>;
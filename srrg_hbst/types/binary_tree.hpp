@@ -1,11 +1,24 @@
 #pragma once
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <stdexcept>
+#if __cplusplus >= 201402L
+#include <shared_mutex>
+#endif
+#include <thread>
 #include <unordered_map>
+#include <utility>
 
 #include "binary_node.hpp"
 
@@ -17,6 +30,13 @@
     return false;                                                     \
   }
 
+// ds software prefetching hint for memory accessed in the near future (no-op if not supported)
+#if defined(__GNUC__) || defined(__clang__)
+#define SRRG_HBST_PREFETCH(ADDRESS) __builtin_prefetch(ADDRESS)
+#else
+#define SRRG_HBST_PREFETCH(ADDRESS)
+#endif
+
 namespace srrg_hbst {
 
   //! @class the binary tree class, consisting of binary nodes holding binary descriptors
@@ -38,6 +58,28 @@ namespace srrg_hbst {
     using MatchVectorMap        = std::unordered_map<uint64_t, std::vector<Match>>;
     using MatchVectorMapElement = std::pair<uint64_t, std::vector<Match>>;
 
+    //! @brief configuration of a tree, passed to all of its nodes: permits trees with different
+    //! parameters in one process - the defaults are taken from the static members at construction
+    struct Configuration : public Node::Configuration {
+#ifdef SRRG_MERGE_DESCRIPTORS
+      //! @brief maximum allowed descriptor distance for merging two descriptors
+      uint32_t maximum_distance_for_merge = BinaryTree::maximum_distance_for_merge;
+#endif
+
+      //! @brief maximum number of leaf splits per insertion call
+      size_t maximum_number_of_splits_per_call = BinaryTree::maximum_number_of_splits_per_call;
+
+      //! @brief sketch prefilter ratio of leaf scans (0 disables the prefilter)
+      double sketch_distance_ratio = BinaryTree::sketch_distance_ratio;
+
+      //! @brief tree size below which queries scan all descriptors linearly (0 disables)
+      size_t maximum_number_of_matchables_linear_search =
+        BinaryTree::maximum_number_of_matchables_linear_search;
+
+      //! @brief queries wait for a pending background insertion (see matchAndAddAsync)
+      bool wait_for_insertion = BinaryTree::wait_for_insertion;
+    };
+
 #ifdef SRRG_MERGE_DESCRIPTORS
     //! @brief component object used for matchable merging
     struct MatchableMerge {
@@ -67,6 +109,189 @@ namespace srrg_hbst {
     };
     typedef std::vector<Score> ScoreVector;
 
+    //! @brief image vote accumulator for a reference image (only allocated for voted images)
+    struct Vote {
+      uint64_t number_of_matches = 0;
+      uint64_t index_query_last  = std::numeric_limits<uint64_t>::max();
+    };
+    typedef std::unordered_map<uint64_t, Vote> VoteHistogram;
+
+    //! @brief reference of a match besides the inline one (see BinaryMatch::number_of_references)
+    struct MatchReference {
+      const Matchable* matchable_reference;
+      ObjectType object_reference;
+    };
+
+    //! @brief sparse per-image match output: all matches in one flat buffer, bucketed by image
+    //! (compressed sparse rows) - only images with at least one match are materialized
+    struct MatchBuffer {
+      //! @brief number of images with at least one match
+      size_t size() const {
+        return identifiers.size();
+      }
+
+      //! @brief matches of the image at index_ (image identifier: identifiers[index_])
+      const Match* begin(const size_t& index_) const {
+        return matches.data() + offsets[index_];
+      }
+      const Match* end(const size_t& index_) const {
+        return matches.data() + offsets[index_ + 1];
+      }
+      size_t numberOfMatches(const size_t& index_) const {
+        return offsets[index_ + 1] - offsets[index_];
+      }
+
+      //! @brief further references of a match tied at its distance (number_of_references - 1)
+      const MatchReference* beginReferences(const Match& match_) const {
+        return references.data() + match_.index_references;
+      }
+      const MatchReference* endReferences(const Match& match_) const {
+        return beginReferences(match_) + match_.number_of_references - 1;
+      }
+
+      //! @brief matched image identifiers in ascending order
+      std::vector<uint64_t> identifiers;
+
+      //! @brief bucket offsets of the images into matches (size: number of images + 1)
+      std::vector<size_t> offsets = std::vector<size_t>(1, 0);
+
+      //! @brief matches grouped by image, in query order within an image
+      MatchVector matches;
+
+      //! @brief side table of the tied references of all matches (see beginReferences)
+      std::vector<MatchReference> references;
+
+      //! @brief staging storage in query order (reused over calls)
+      std::vector<uint64_t> identifiers_unsorted;
+      MatchVector matches_unsorted;
+    };
+
+    //! @brief range search output: all references within the radius of every query in one flat
+    //! buffer, bucketed by query (compressed sparse rows) - storage is reused over calls
+    struct RadiusMatchBuffer {
+      //! @brief number of queries
+      size_t size() const {
+        return offsets.size() - 1;
+      }
+
+      //! @brief matches of the query at index_query_, nearest first (one reference per match)
+      const Match* begin(const size_t& index_query_) const {
+        return matches.data() + offsets[index_query_];
+      }
+      const Match* end(const size_t& index_query_) const {
+        return matches.data() + offsets[index_query_ + 1];
+      }
+      size_t numberOfMatches(const size_t& index_query_) const {
+        return offsets[index_query_ + 1] - offsets[index_query_];
+      }
+
+      //! @brief bucket offsets of the queries into matches (size: number of queries + 1)
+      std::vector<size_t> offsets = std::vector<size_t>(1, 0);
+
+      //! @brief matches grouped by query
+      MatchVector matches;
+    };
+
+    //! @brief restricts a search to a subset of the reference images: an identifier range, an
+    //! excluded identifier window (e.g. the most recent keyframes) and an optional bitmap - the
+    //! filter is applied within the leaf scan, leafs without eligible images are not scanned
+    struct ImageFilter {
+      //! @brief checks whether an image is eligible
+      bool isEligible(const uint64_t& identifier_image_) const {
+        return identifier_image_ >= identifier_minimum && identifier_image_ <= identifier_maximum &&
+               (identifier_image_ < identifier_excluded_begin ||
+                identifier_image_ >= identifier_excluded_end) &&
+               (eligible_images.empty() || (identifier_image_ < eligible_images.size() &&
+                                            eligible_images[identifier_image_]));
+      }
+
+      //! @brief checks whether an image identifier range may contain an eligible image
+      //! (conservative: the bitmap is not considered)
+      bool isEligible(const uint64_t& identifier_image_minimum_,
+                      const uint64_t& identifier_image_maximum_) const {
+        const uint64_t identifier_begin = std::max(identifier_image_minimum_, identifier_minimum);
+        const uint64_t identifier_end   = std::min(identifier_image_maximum_, identifier_maximum);
+        return identifier_begin <= identifier_end &&
+               (identifier_begin < identifier_excluded_begin ||
+                identifier_end >= identifier_excluded_end);
+      }
+
+      //! @brief eligible image identifier range (inclusive)
+      uint64_t identifier_minimum = 0;
+      uint64_t identifier_maximum = std::numeric_limits<uint64_t>::max();
+
+      //! @brief excluded image identifier window [begin, end) - empty by default
+      uint64_t identifier_excluded_begin = 0;
+      uint64_t identifier_excluded_end   = 0;
+
+      //! @brief eligibility per image identifier (all images are eligible if empty)
+      std::vector<bool> eligible_images;
+    };
+
+    //! @brief last descent of a track: destination leaf and the split bits on the path to it
+    struct TrackDescent {
+      const Node* leaf = nullptr;
+      Descriptor path_mask;
+      Descriptor path_bits;
+    };
+
+    //! @brief per-track descent cache for temporally coherent queries (e.g. tracked landmarks),
+    //! keyed by a caller supplied track identifier - a query that agrees with the split bits on the
+    //! cached path of its track starts in the cached leaf instead of the root (and continues below
+    //! it if the leaf has been split since). the cache is owned by the caller (lost tracks can be
+    //! erased) and is flushed automatically if used with another or a cleared tree
+    struct TrackCache {
+      std::unordered_map<uint64_t, TrackDescent> tracks;
+      uint64_t identifier_structure = 0;
+    };
+
+    //! @brief lightweight query view on caller owned descriptors and query objects - enables
+    //! queries without allocating a matchable per descriptor (resulting matches carry no query
+    //! matchable, i.e. Match.matchable_query is nullptr)
+    struct DescriptorQueries {
+      //! @brief view on contiguous descriptors and their objects (e.g. keypoint indices)
+      //! @param[in] descriptors_ query descriptors
+      //! @param[in] objects_ query objects, one per descriptor
+      //! @param[in] number_of_queries_ number of descriptors and objects
+      DescriptorQueries(const Descriptor* descriptors_,
+                        const ObjectType* objects_,
+                        const size_t& number_of_queries_) :
+        descriptors(descriptors_),
+        objects(objects_),
+        number_of_queries(number_of_queries_) {
+      }
+
+      //! @brief view on descriptor and object vectors of equal size
+      DescriptorQueries(const std::vector<Descriptor>& descriptors_,
+                        const std::vector<ObjectType>& objects_) :
+        DescriptorQueries(descriptors_.data(), objects_.data(), descriptors_.size()) {
+        assert(descriptors_.size() == objects_.size());
+      }
+
+      size_t size() const {
+        return number_of_queries;
+      }
+      const Descriptor& descriptor(const size_t& index_) const {
+        return descriptors[index_];
+      }
+      const Matchable* matchable(const size_t& /*index_*/) const {
+        return nullptr;
+      }
+      const ObjectType& object(const size_t& index_) const {
+        return objects[index_];
+      }
+
+      const Descriptor* descriptors;
+      const ObjectType* objects;
+      size_t number_of_queries;
+
+      //! @brief no per-track descent cache
+      static constexpr bool tracked = false;
+      TrackDescent* track(const size_t& /*index_*/) const {
+        return nullptr;
+      }
+    };
+
     //! @brief object header containing main attributes
     struct Header {
       Header(const uint64_t& identifier_ = 0) :
@@ -91,8 +316,11 @@ namespace srrg_hbst {
 
     // ds ctor/dtor
   public:
-    // ds empty tree instantiation with specific identifier
-    BinaryTree(const uint64_t& identifier_) : _header(identifier_), _root(nullptr) {
+    // ds empty tree instantiation with specific identifier (and configuration)
+    BinaryTree(const uint64_t& identifier_, const Configuration& configuration_ = Configuration()) :
+      _configuration(configuration_),
+      _header(identifier_),
+      _root(nullptr) {
       _matchables.clear();
       _matchables_to_train.clear();
       _added_identifiers_train.clear();
@@ -106,12 +334,18 @@ namespace srrg_hbst {
     BinaryTree() : BinaryTree(0) {
     }
 
+    // ds empty tree instantiation with configuration
+    explicit BinaryTree(const Configuration& configuration_) : BinaryTree(0, configuration_) {
+    }
+
     // ds construct tree upon allocation on filtered descriptors
     BinaryTree(const uint64_t& identifier_,
                const MatchableVector& matchables_,
-               const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) :
+               const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven,
+               const Configuration& configuration_  = Configuration()) :
+      _configuration(configuration_),
       _header(identifier_),
-      _root(new Node(matchables_, train_mode_)) {
+      _root(new Node(&_configuration, matchables_, train_mode_)) {
       _matchables.clear();
       _matchables.insert(_matchables.end(), matchables_.begin(), matchables_.end());
       _matchables_to_train.clear();
@@ -121,21 +355,25 @@ namespace srrg_hbst {
 #ifdef SRRG_MERGE_DESCRIPTORS
       _merged_matchables.clear();
 #endif
+      _updateLinearStorage();
     }
 
     // ds construct tree upon allocation on filtered descriptors
     BinaryTree(const MatchableVector& matchables_,
-               const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) :
-      BinaryTree(0, matchables_, train_mode_) {
+               const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven,
+               const Configuration& configuration_  = Configuration()) :
+      BinaryTree(0, matchables_, train_mode_, configuration_) {
     }
 
     // ds construct tree upon allocation on filtered descriptors: with bit mask
     BinaryTree(const uint64_t& identifier_,
                const MatchableVector& matchables_,
                Descriptor bit_mask_,
-               const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) :
+               const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven,
+               const Configuration& configuration_  = Configuration()) :
+      _configuration(configuration_),
       _header(identifier_),
-      _root(new Node(matchables_, bit_mask_, train_mode_)) {
+      _root(new Node(&_configuration, matchables_, bit_mask_, train_mode_)) {
       _matchables.clear();
       _matchables.insert(_matchables.end(), matchables_.begin(), matchables_.end());
       _matchables_to_train.clear();
@@ -145,6 +383,7 @@ namespace srrg_hbst {
 #ifdef SRRG_MERGE_DESCRIPTORS
       _merged_matchables.clear();
 #endif
+      _updateLinearStorage();
     }
 
     // ds free all nodes in the tree without freeing the matchables - call clear(true)
@@ -223,6 +462,20 @@ namespace srrg_hbst {
       return _root;
     }
 
+    //! @brief accessors to the configuration of this tree - changes affect subsequent insertions
+    const Configuration& configuration() const {
+      return _configuration;
+    }
+    Configuration& configuration() {
+      return _configuration;
+    }
+
+    //! @brief number of touched leafs still waiting for their split check (see Configuration) -
+    //! pending leafs remain regular, queryable leafs
+    const size_t numberOfPendingLeafs() const {
+      return _leafs_to_split.size();
+    }
+
     //! number of merged matchables in last call
     const size_t numberOfMergedMatchablesLastTraining() const {
 #ifdef SRRG_MERGE_DESCRIPTORS
@@ -245,294 +498,520 @@ namespace srrg_hbst {
 
     const uint64_t getNumberOfMatches(const MatchableVector& matchables_query_,
                                       const uint32_t& maximum_distance_ = 25) const {
-      if (matchables_query_.empty()) {
-        return 0;
-      }
-      uint64_t number_of_matches = 0;
+      return _getNumberOfMatches(MatchableQueries(matchables_query_), maximum_distance_);
+    }
 
-      // ds for each descriptor
-      for (const Matchable* matchable_query : matchables_query_) {
-        // ds traverse tree to find this descriptor
-        const Node* node_current = _root;
-        while (node_current) {
-          // ds if this node has leaves (is splittable)
-          if (node_current->has_leafs) {
-            // ds check the split bit and go deeper
-            if (matchable_query->descriptor[node_current->index_split_bit]) {
-              node_current = node_current->right;
-            } else {
-              node_current = node_current->left;
-            }
-          } else {
-            // ds check current descriptors in this node and exit
-            for (const Matchable* matchable_reference : node_current->matchables) {
-              if (maximum_distance_ > matchable_query->distance(matchable_reference)) {
-                ++number_of_matches;
-                break;
-              }
-            }
-            break;
-          }
-        }
-      }
-      return number_of_matches;
+    //! @brief getNumberOfMatches for raw query descriptors (no matchable allocation)
+    const uint64_t getNumberOfMatches(const DescriptorQueries& descriptors_query_,
+                                      const uint32_t& maximum_distance_ = 25) const {
+      return _getNumberOfMatches(descriptors_query_, maximum_distance_);
     }
 
     const ScoreVector getScorePerImage(const MatchableVector& matchables_query_,
                                        const bool sort_output           = false,
                                        const uint32_t maximum_distance_ = 25) const {
-      if (matchables_query_.empty()) {
-        return ScoreVector(0);
-      }
-      ScoreVector scores_per_image(_added_identifiers_train.size());
+      return _getScorePerImage(MatchableQueries(matchables_query_), sort_output, maximum_distance_);
+    }
 
-      // ds identifier to vector index mapping - simultaneously initialize result vector
-      std::map<uint64_t, uint64_t> mapping_identifier_image_to_score;
-      for (const uint64_t& identifier_reference : _added_identifiers_train) {
-        scores_per_image[mapping_identifier_image_to_score.size()].identifier_reference =
-          identifier_reference;
-        mapping_identifier_image_to_score.insert(
-          std::make_pair(identifier_reference, mapping_identifier_image_to_score.size()));
-      }
+    //! @brief getScorePerImage for raw query descriptors (no matchable allocation)
+    const ScoreVector getScorePerImage(const DescriptorQueries& descriptors_query_,
+                                       const bool sort_output           = false,
+                                       const uint32_t maximum_distance_ = 25) const {
+      return _getScorePerImage(descriptors_query_, sort_output, maximum_distance_);
+    }
 
-      // ds for each query descriptor
-      for (const Matchable* matchable_query : matchables_query_) {
-        // ds traverse tree to find this descriptor
-        const Node* node_current = _root;
-        while (node_current) {
-          // ds if this node has leaves (is splittable)
-          if (node_current->has_leafs) {
-            // ds check the split bit and go deeper
-            if (matchable_query->descriptor[node_current->index_split_bit]) {
-              node_current = node_current->right;
-            } else {
-              node_current = node_current->left;
-            }
-          } else {
-            // ds check current descriptors for each reference image in this node and exit
-            std::set<uint64_t> matched_references;
-            for (const Matchable* matchable_reference : node_current->matchables) {
-              if (matchable_query->distance(matchable_reference) < maximum_distance_) {
-#ifdef SRRG_MERGE_DESCRIPTORS
-                for (const ObjectMapElement& object : matchable_reference->objects) {
-                  const uint64_t& identifier_reference = object.first;
-#else
-                const uint64_t& identifier_reference = matchable_reference->_image_identifier;
-#endif
+    //! @brief getScorePerImage restricted to the reference images accepted by an image filter
+    //! @param[in] matchables_query_ query matchables
+    //! @param[in] sort_output sort scores in descending order by matching ratio
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] image_filter_ eligible reference images (see ImageFilter)
+    //! @returns a score for every eligible trained image
+    const ScoreVector getScorePerImage(const MatchableVector& matchables_query_,
+                                       const bool sort_output,
+                                       const uint32_t maximum_distance_,
+                                       const ImageFilter& image_filter_) const {
+      return _getScorePerImage(
+        MatchableQueries(matchables_query_), sort_output, maximum_distance_, &image_filter_);
+    }
 
-                  // ds the query matchable can be matched only once to each reference image
-                  if (matched_references.count(identifier_reference) == 0) {
-                    ++scores_per_image[mapping_identifier_image_to_score.at(identifier_reference)]
-                        .number_of_matches;
-                    matched_references.insert(identifier_reference);
-                  }
-#ifdef SRRG_MERGE_DESCRIPTORS
-                }
-#endif
-              }
-            }
-            break;
-          }
-        }
-      }
+    //! @brief filtered getScorePerImage for raw query descriptors (no matchable allocation)
+    const ScoreVector getScorePerImage(const DescriptorQueries& descriptors_query_,
+                                       const bool sort_output,
+                                       const uint32_t maximum_distance_,
+                                       const ImageFilter& image_filter_) const {
+      return _getScorePerImage(descriptors_query_, sort_output, maximum_distance_, &image_filter_);
+    }
 
-      // ds compute relative scores
-      const real_type number_of_query_descriptors = matchables_query_.size();
-      for (Score& score : scores_per_image) {
-        score.matching_ratio = score.number_of_matches / number_of_query_descriptors;
-      }
+    //! @brief retrieves the K best scoring reference images (e.g. place recognition candidates)
+    //! the cost scales with the number of images that received a vote, not the database size
+    //! @param[in] matchables_query_ query matchables
+    //! @param[in] number_of_images_ the desired number of best images K
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] number_of_threads_ number of threads used for vote accumulation
+    //! @returns at most K scores, sorted in descending order by matching ratio
+    const ScoreVector getTopKImages(const MatchableVector& matchables_query_,
+                                    const size_t& number_of_images_,
+                                    const uint32_t& maximum_distance_ = 25,
+                                    const size_t& number_of_threads_  = 1) const {
+      return _getTopKImages(MatchableQueries(matchables_query_),
+                            number_of_images_,
+                            maximum_distance_,
+                            number_of_threads_);
+    }
 
-      // ds if desired, sort in descending order by matching ratio
-      if (sort_output) {
-        std::sort(
-          scores_per_image.begin(), scores_per_image.end(), [](const Score& a, const Score& b) {
-            return a.matching_ratio > b.matching_ratio;
-          });
-      }
-      return scores_per_image;
+    //! @brief getTopKImages for raw query descriptors (no matchable allocation)
+    const ScoreVector getTopKImages(const DescriptorQueries& descriptors_query_,
+                                    const size_t& number_of_images_,
+                                    const uint32_t& maximum_distance_ = 25,
+                                    const size_t& number_of_threads_  = 1) const {
+      return _getTopKImages(
+        descriptors_query_, number_of_images_, maximum_distance_, number_of_threads_);
+    }
+
+    //! @brief getTopKImages restricted to the reference images accepted by an image filter
+    //! @param[in] matchables_query_ query matchables
+    //! @param[in] number_of_images_ the desired number of best images K
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] number_of_threads_ number of threads used for vote accumulation
+    //! @param[in] image_filter_ eligible reference images (see ImageFilter)
+    //! @returns at most K eligible scores, sorted in descending order by matching ratio
+    const ScoreVector getTopKImages(const MatchableVector& matchables_query_,
+                                    const size_t& number_of_images_,
+                                    const uint32_t& maximum_distance_,
+                                    const size_t& number_of_threads_,
+                                    const ImageFilter& image_filter_) const {
+      return _getTopKImages(MatchableQueries(matchables_query_),
+                            number_of_images_,
+                            maximum_distance_,
+                            number_of_threads_,
+                            &image_filter_);
+    }
+
+    //! @brief filtered getTopKImages for raw query descriptors (no matchable allocation)
+    const ScoreVector getTopKImages(const DescriptorQueries& descriptors_query_,
+                                    const size_t& number_of_images_,
+                                    const uint32_t& maximum_distance_,
+                                    const size_t& number_of_threads_,
+                                    const ImageFilter& image_filter_) const {
+      return _getTopKImages(descriptors_query_,
+                            number_of_images_,
+                            maximum_distance_,
+                            number_of_threads_,
+                            &image_filter_);
     }
 
     const uint64_t getNumberOfMatchesLazy(const MatchableVector& matchables_query_,
                                           const uint32_t& maximum_distance_ = 25) const {
-      if (matchables_query_.empty()) {
-        return 0;
-      }
-      uint64_t number_of_matches = 0;
+      return _getNumberOfMatchesLazy(MatchableQueries(matchables_query_), maximum_distance_);
+    }
 
-      // ds for each descriptor
-      for (const Matchable* matchable_query : matchables_query_) {
-        // ds traverse tree to find this descriptor
-        const Node* node_current = _root;
-        while (node_current) {
-          // ds if this node has leaves (is splittable)
-          if (node_current->has_leafs) {
-            // ds check the split bit and go deeper
-            if (matchable_query->descriptor[node_current->index_split_bit]) {
-              node_current = node_current->right;
-            } else {
-              node_current = node_current->left;
-            }
-          } else {
-            // ds check current descriptors in this node and exit
-            if (maximum_distance_ > matchable_query->distance(node_current->matchables.front())) {
-              ++number_of_matches;
-            }
-            break;
-          }
-        }
-      }
-      return number_of_matches;
+    //! @brief getNumberOfMatchesLazy for raw query descriptors (no matchable allocation)
+    const uint64_t getNumberOfMatchesLazy(const DescriptorQueries& descriptors_query_,
+                                          const uint32_t& maximum_distance_ = 25) const {
+      return _getNumberOfMatchesLazy(descriptors_query_, maximum_distance_);
     }
 
     // ds direct matching function on this tree
     void matchLazy(const MatchableVector& matchables_query_,
                    MatchVector& matches_,
                    const uint32_t& maximum_distance_ = 25) const {
-      if (matchables_query_.empty()) {
-        return;
-      }
+      _matchLazy(MatchableQueries(matchables_query_), matches_, maximum_distance_);
+    }
 
-      // ds for each descriptor
-      for (const Matchable* matchable_query : matchables_query_) {
-        // ds traverse tree to find this descriptor
-        const Node* node_current = _root;
-        while (node_current) {
-          // ds if this node has leaves (is splittable)
-          if (node_current->has_leafs) {
-            // ds check the split bit and go deeper
-            if (matchable_query->descriptor[node_current->index_split_bit]) {
-              node_current = node_current->right;
-            } else {
-              node_current = node_current->left;
-            }
-          } else {
-            // ds check current descriptors in this node and exit
-            for (const Matchable* matchable_reference : node_current->matchables) {
-              const real_type distance = matchable_query->distance(matchable_reference);
-              if (distance < maximum_distance_) {
-                matches_.push_back(Match(matchable_query,
-                                         matchable_reference,
-                                         matchable_query->objects.begin()->second,
-                                         matchable_reference->objects.begin()->second,
-                                         distance));
-                break;
-              }
-            }
-            break;
-          }
-        }
-      }
+    //! @brief matchLazy for raw query descriptors (no matchable allocation)
+    void matchLazy(const DescriptorQueries& descriptors_query_,
+                   MatchVector& matches_,
+                   const uint32_t& maximum_distance_ = 25) const {
+      _matchLazy(descriptors_query_, matches_, maximum_distance_);
     }
 
     // ds direct matching function on this tree
     void match(const MatchableVector& matchables_query_,
                MatchVector& matches_,
                const uint32_t& maximum_distance_ = 25) const {
-      if (matchables_query_.empty()) {
-        return;
-      }
-
-      // ds for each descriptor
-      for (const Matchable* matchable_query : matchables_query_) {
-        // ds traverse tree to find this descriptor
-        const Node* node_current = _root;
-        while (node_current) {
-          // ds if this node has leaves (is splittable)
-          if (node_current->has_leafs) {
-            // ds check the split bit and go deeper
-            if (matchable_query->descriptor[node_current->index_split_bit]) {
-              node_current = node_current->right;
-            } else {
-              node_current = node_current->left;
-            }
-          } else {
-            // ds current best (0 if none)
-            const Matchable* matchable_reference_best = nullptr;
-            uint32_t distance_best                    = maximum_distance_;
-
-            // ds check current descriptors in this node and exit
-            for (const Matchable* matchable_reference : node_current->matchables) {
-              const uint32_t& distance = matchable_query->distance(matchable_reference);
-              if (distance < distance_best) {
-                matchable_reference_best = matchable_reference;
-                distance_best            = distance;
-              }
-            }
-
-            // ds if a match was found
-            if (matchable_reference_best) {
-              matches_.push_back(Match(matchable_query,
-                                       matchable_reference_best,
-                                       matchable_query->objects.begin()->second,
-                                       matchable_reference_best->objects.begin()->second,
-                                       distance_best));
-            }
-            break;
-          }
-        }
-      }
+      _match(MatchableQueries(matchables_query_), matches_, maximum_distance_);
     }
 
-    // ds return matches directly
-    const std::shared_ptr<const MatchVector>
-    getMatchesLazy(const std::shared_ptr<const MatchableVector> matchables_query_,
-                   const uint32_t& maximum_distance_ = 25) const {
-      // ds wrap the call
-      MatchVector matches;
-      matchLazy(*matchables_query_, matches, maximum_distance_);
-      return std::make_shared<const MatchVector>(matches);
+    //! @brief match for raw query descriptors (no matchable allocation)
+    void match(const DescriptorQueries& descriptors_query_,
+               MatchVector& matches_,
+               const uint32_t& maximum_distance_ = 25) const {
+      _match(descriptors_query_, matches_, maximum_distance_);
     }
 
-    //! @brief knn multi-matching function
+    //! @brief match restricted to the reference images accepted by an image filter
     //! @param[in] matchables_query_ query matchables
-    //! @param[out] matches_ output matching results: contains all available matches for all
-    //! training images added to the tree
+    //! @param[out] matches_ output matching results (best eligible reference per query)
     //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] image_filter_ eligible reference images (see ImageFilter)
     void match(const MatchableVector& matchables_query_,
-               MatchVectorMap& matches_,
-               const uint32_t& maximum_distance_matching_ = 25) const {
-      if (matchables_query_.empty() || _added_identifiers_train.empty()) {
-        return;
-      }
+               MatchVector& matches_,
+               const uint32_t& maximum_distance_,
+               const ImageFilter& image_filter_) const {
+      _match(MatchableQueries(matchables_query_), matches_, maximum_distance_, &image_filter_);
+    }
 
-      // ds prepare match vector map for all ids in the tree
-      matches_.clear();
-      for (const uint64_t identifier_tree : _added_identifiers_train) {
-        matches_.insert(std::make_pair(identifier_tree, MatchVector()));
+    //! @brief filtered match for raw query descriptors (no matchable allocation)
+    void match(const DescriptorQueries& descriptors_query_,
+               MatchVector& matches_,
+               const uint32_t& maximum_distance_,
+               const ImageFilter& image_filter_) const {
+      _match(descriptors_query_, matches_, maximum_distance_, &image_filter_);
+    }
 
-        // ds preallocate space to speed up match addition
-        matches_.at(identifier_tree).reserve(matchables_query_.size());
-      }
+    //! @brief match with a per-track descent cache (results identical to match)
+    //! @param[in] matchables_query_ query matchables
+    //! @param[in] identifiers_track_ track identifier of each query (e.g. landmark identifier)
+    //! @param[in,out] track_cache_ descent cache, updated with the descents of the queries
+    //! @param[out] matches_ output matching results
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    void match(const MatchableVector& matchables_query_,
+               const std::vector<uint64_t>& identifiers_track_,
+               TrackCache& track_cache_,
+               MatchVector& matches_,
+               const uint32_t& maximum_distance_ = 25) const {
+      _match(
+        _getTrackedQueries(MatchableQueries(matchables_query_), identifiers_track_, track_cache_),
+        matches_,
+        maximum_distance_);
+    }
 
-      // ds for each descriptor
-      for (const Matchable* matchable_query : matchables_query_) {
-        // ds traverse tree to find this descriptor
-        const Node* node_current = _root;
-        while (node_current) {
-          // ds if this node has leaves (is splittable)
-          if (node_current->has_leafs) {
-            // ds check the split bit and go deeper
-            if (matchable_query->descriptor[node_current->index_split_bit]) {
-              node_current = node_current->right;
-            } else {
-              node_current = node_current->left;
-            }
-          } else {
-            // ds obtain best matches in the current leaf via brute-force search
-            std::map<uint64_t, Match> best_matches;
-            _matchExhaustive(
-              matchable_query, node_current->matchables, maximum_distance_matching_, best_matches);
+    //! @brief match with a per-track descent cache for raw query descriptors
+    void match(const DescriptorQueries& descriptors_query_,
+               const std::vector<uint64_t>& identifiers_track_,
+               TrackCache& track_cache_,
+               MatchVector& matches_,
+               const uint32_t& maximum_distance_ = 25) const {
+      _match(_getTrackedQueries(descriptors_query_, identifiers_track_, track_cache_),
+             matches_,
+             maximum_distance_);
+    }
 
-            // ds register all matches in the output structure
-            for (const std::pair<uint64_t, Match> best_match : best_matches) {
-              matches_.at(best_match.first).push_back(best_match.second);
-            }
-            break;
-          }
+    //! @brief match with a ratio test fused into the leaf scan: best and second best reference
+    //! distances are tracked together and only unambiguous best matches are reported
+    //! @param[in] matchables_query_ query matchables
+    //! @param[out] matches_ output matching results
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] ratio_ a best match is reported if its distance is below ratio_ times the second
+    //! best distance - the second best is searched independently of maximum_distance_
+    void matchWithRatio(const MatchableVector& matchables_query_,
+                        MatchVector& matches_,
+                        const uint32_t& maximum_distance_ = 25,
+                        const real_type& ratio_           = 0.8) const {
+      _matchWithRatio(MatchableQueries(matchables_query_), matches_, maximum_distance_, ratio_);
+    }
+
+    //! @brief matchWithRatio for raw query descriptors (no matchable allocation)
+    void matchWithRatio(const DescriptorQueries& descriptors_query_,
+                        MatchVector& matches_,
+                        const uint32_t& maximum_distance_ = 25,
+                        const real_type& ratio_           = 0.8) const {
+      _matchWithRatio(descriptors_query_, matches_, maximum_distance_, ratio_);
+    }
+
+    //! @brief exact variant of match: instead of the single leaf descent, subtrees are explored
+    //! best-first in order of their distance lower bound (mismatched split bits on the path and
+    //! bit summaries) until no unexplored subtree can beat the current best reference
+    //! @param[in] matchables_query_ query matchables
+    //! @param[out] matches_ output matching results: the nearest reference within
+    //! maximum_distance_ of every query (guaranteed)
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @returns number of leafs visited over all queries (match visits one leaf per query)
+    size_t matchExact(const MatchableVector& matchables_query_,
+                      MatchVector& matches_,
+                      const uint32_t& maximum_distance_ = 25) const {
+      return _matchExact(MatchableQueries(matchables_query_), matches_, maximum_distance_);
+    }
+
+    //! @brief matchExact for raw query descriptors (no matchable allocation)
+    size_t matchExact(const DescriptorQueries& descriptors_query_,
+                      MatchVector& matches_,
+                      const uint32_t& maximum_distance_ = 25) const {
+      return _matchExact(descriptors_query_, matches_, maximum_distance_);
+    }
+
+    //! @brief mutual (cross-check) matching of two frames: the queries are matched against this
+    //! tree and only their best references are matched back against the tree of the queries -
+    //! pairs that are mutually best are reported (no second full pass, no per image output)
+    //! @param[in] matchables_query_ query matchables, all contained in tree_query_
+    //! @param[in] tree_query_ tree built from the query matchables - with SRRG_MERGE_DESCRIPTORS
+    //! it must not have merged any matchable (merged query matchables are freed by the tree)
+    //! @param[out] matches_ output matching results: mutually best matches in query order
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    void matchMutual(const MatchableVector& matchables_query_,
+                     const BinaryTree& tree_query_,
+                     MatchVector& matches_,
+                     const uint32_t& maximum_distance_ = 25) const {
+      if (matchables_query_.empty() || !_root || !tree_query_._root) {
+        return;
+      }
+#ifdef SRRG_MERGE_DESCRIPTORS
+      if (tree_query_._number_of_merged_matchables_total > 0) {
+        throw std::runtime_error("BinaryTree::matchMutual|ERROR: query tree merged matchables");
+      }
+#endif
+
+      // ds forward pass: best reference in this tree for every query
+      MatchVector matches_forward;
+      matches_forward.reserve(matchables_query_.size());
+      _match(MatchableQueries(matchables_query_), matches_forward, maximum_distance_);
+
+      // ds backward pass: best query in the query tree for every candidate reference
+      std::vector<Descriptor> descriptors_reference;
+      std::vector<ObjectType> objects_reference;
+      descriptors_reference.reserve(matches_forward.size());
+      objects_reference.reserve(matches_forward.size());
+      for (const Match& match : matches_forward) {
+        descriptors_reference.push_back(match.matchable_reference->descriptor);
+        objects_reference.push_back(match.object_reference);
+      }
+      std::vector<const Matchable*> matchables_query_best(matches_forward.size(), nullptr);
+      tree_query_._matchVisit(DescriptorQueries(descriptors_reference, objects_reference),
+                              maximum_distance_,
+                              [&matchables_query_best](const size_t& index_match_,
+                                                       const Matchable* matchable_query_,
+                                                       const uint32_t& /*distance_*/) {
+                                matchables_query_best[index_match_] = matchable_query_;
+                              });
+
+      // ds keep mutually best pairs
+      for (size_t index_match = 0; index_match < matches_forward.size(); ++index_match) {
+        if (matchables_query_best[index_match] == matches_forward[index_match].matchable_query) {
+          matches_.push_back(matches_forward[index_match]);
         }
       }
     }
 
+    //! @brief leaf-major batch variant of match: all queries are descended first, grouped by their
+    //! destination leaf and each leaf is scanned once against all of its queries
+    //! @param[in] matchables_query_ query matchables
+    //! @param[out] matches_ output matching results (identical to match)
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    void matchBatch(const MatchableVector& matchables_query_,
+                    MatchVector& matches_,
+                    const uint32_t& maximum_distance_ = 25) const {
+      _matchBatch(MatchableQueries(matchables_query_), matches_, maximum_distance_, false);
+    }
+
+    //! @brief matchBatch for raw query descriptors (no matchable allocation)
+    void matchBatch(const DescriptorQueries& descriptors_query_,
+                    MatchVector& matches_,
+                    const uint32_t& maximum_distance_ = 25) const {
+      _matchBatch(descriptors_query_, matches_, maximum_distance_, false);
+    }
+
+    //! @brief leaf-major batch variant of matchLazy (see matchBatch)
+    //! @param[in] matchables_query_ query matchables
+    //! @param[out] matches_ output matching results (identical to matchLazy)
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    void matchLazyBatch(const MatchableVector& matchables_query_,
+                        MatchVector& matches_,
+                        const uint32_t& maximum_distance_ = 25) const {
+      _matchBatch(MatchableQueries(matchables_query_), matches_, maximum_distance_, true);
+    }
+
+    //! @brief matchLazyBatch for raw query descriptors (no matchable allocation)
+    void matchLazyBatch(const DescriptorQueries& descriptors_query_,
+                        MatchVector& matches_,
+                        const uint32_t& maximum_distance_ = 25) const {
+      _matchBatch(descriptors_query_, matches_, maximum_distance_, true);
+    }
+
+    //! @brief range search: retrieves all references within radius_ of every query
+    //! @param[in] matchables_query_ query matchables
+    //! @param[out] matches_ output matching results, bucketed by query (see RadiusMatchBuffer)
+    //! @param[in] radius_ maximum distance of a returned reference (inclusive)
+    //! @param[in] maximum_number_of_matches_per_query_ only the nearest references are kept
+    //! @param[in] number_of_probes_ number of additional leafs scanned per query behind the split
+    //! boundaries of its descent path (0: only the destination leaf as in match)
+    void matchRadius(
+      const MatchableVector& matchables_query_,
+      RadiusMatchBuffer& matches_,
+      const uint32_t& radius_,
+      const size_t& maximum_number_of_matches_per_query_ = std::numeric_limits<size_t>::max(),
+      const size_t& number_of_probes_                    = 0) const {
+      _matchRadius(MatchableQueries(matchables_query_),
+                   matches_,
+                   radius_,
+                   maximum_number_of_matches_per_query_,
+                   number_of_probes_);
+    }
+
+    //! @brief matchRadius for raw query descriptors (no matchable allocation)
+    void matchRadius(
+      const DescriptorQueries& descriptors_query_,
+      RadiusMatchBuffer& matches_,
+      const uint32_t& radius_,
+      const size_t& maximum_number_of_matches_per_query_ = std::numeric_limits<size_t>::max(),
+      const size_t& number_of_probes_                    = 0) const {
+      _matchRadius(descriptors_query_,
+                   matches_,
+                   radius_,
+                   maximum_number_of_matches_per_query_,
+                   number_of_probes_);
+    }
+
+    //! @brief streaming variant of match: instead of materializing matches, the visitor is called
+    //! for the best reference of every matched query directly from within the leaf scan
+    //! @param[in] matchables_query_ query matchables
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] visitor_ callable with signature (const size_t& index_query, const Matchable*
+    //! matchable_reference, const uint32_t& distance)
+    template <typename VisitorType_>
+    void match(const MatchableVector& matchables_query_,
+               const uint32_t& maximum_distance_,
+               VisitorType_&& visitor_) const {
+      _matchVisit(MatchableQueries(matchables_query_),
+                  maximum_distance_,
+                  std::forward<VisitorType_>(visitor_));
+    }
+
+    //! @brief streaming match for raw query descriptors (no matchable allocation)
+    template <typename VisitorType_>
+    void match(const DescriptorQueries& descriptors_query_,
+               const uint32_t& maximum_distance_,
+               VisitorType_&& visitor_) const {
+      _matchVisit(descriptors_query_, maximum_distance_, std::forward<VisitorType_>(visitor_));
+    }
+
+    //! @brief streaming variant of matchLazy (see streaming match)
+    //! @param[in] matchables_query_ query matchables
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] visitor_ callable with signature (const size_t& index_query, const Matchable*
+    //! matchable_reference, const uint32_t& distance)
+    template <typename VisitorType_>
+    void matchLazy(const MatchableVector& matchables_query_,
+                   const uint32_t& maximum_distance_,
+                   VisitorType_&& visitor_) const {
+      _matchLazyVisit(MatchableQueries(matchables_query_),
+                      maximum_distance_,
+                      std::forward<VisitorType_>(visitor_));
+    }
+
+    //! @brief streaming matchLazy for raw query descriptors (no matchable allocation)
+    template <typename VisitorType_>
+    void matchLazy(const DescriptorQueries& descriptors_query_,
+                   const uint32_t& maximum_distance_,
+                   VisitorType_&& visitor_) const {
+      _matchLazyVisit(descriptors_query_, maximum_distance_, std::forward<VisitorType_>(visitor_));
+    }
+
+    //! @brief streaming variant of the knn multi-matching function: the visitor is called for the
+    //! best match of every query in every reference image (e.g. for image voting)
+    //! @param[in] matchables_query_ query matchables
+    //! @param[in] maximum_distance_matching_ the maximum distance allowed for a positive match
+    //! @param[in] visitor_ callable with signature (const uint64_t& identifier_reference, const
+    //! Match& match)
+    template <typename VisitorType_>
+    void matchPerImage(const MatchableVector& matchables_query_,
+                       const uint32_t& maximum_distance_matching_,
+                       VisitorType_&& visitor_) const {
+      _matchPerImageVisit(MatchableQueries(matchables_query_),
+                          maximum_distance_matching_,
+                          std::forward<VisitorType_>(visitor_));
+    }
+
+    //! @brief streaming knn multi-matching for raw query descriptors (no matchable allocation)
+    template <typename VisitorType_>
+    void matchPerImage(const DescriptorQueries& descriptors_query_,
+                       const uint32_t& maximum_distance_matching_,
+                       VisitorType_&& visitor_) const {
+      _matchPerImageVisit(
+        descriptors_query_, maximum_distance_matching_, std::forward<VisitorType_>(visitor_));
+    }
+
+    // ds return matches directly
+    const std::shared_ptr<const MatchVector>
+    getMatchesLazy(const std::shared_ptr<const MatchableVector> matchables_query_,
+                   const uint32_t& maximum_distance_ = 25) const {
+      // ds wrap the call
+      MatchVector matches;
+      matchLazy(*matchables_query_, matches, maximum_distance_);
+      return std::make_shared<const MatchVector>(matches);
+    }
+
+    //! @brief knn multi-matching function
+    //! @param[in] matchables_query_ query matchables
+    //! @param[out] matches_ output matching results: contains all available matches for all
+    //! training images added to the tree
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    void match(const MatchableVector& matchables_query_,
+               MatchVectorMap& matches_,
+               const uint32_t& maximum_distance_matching_ = 25) const {
+      _matchPerImage(MatchableQueries(matchables_query_), matches_, maximum_distance_matching_);
+    }
+
+    //! @brief knn multi-matching function for raw query descriptors (no matchable allocation)
+    void match(const DescriptorQueries& descriptors_query_,
+               MatchVectorMap& matches_,
+               const uint32_t& maximum_distance_matching_ = 25) const {
+      _matchPerImage(descriptors_query_, matches_, maximum_distance_matching_);
+    }
+
+    //! @brief knn multi-matching function restricted to the images accepted by an image filter
+    //! @param[in] matchables_query_ query matchables
+    //! @param[out] matches_ output matching results: contains the matches of all training images
+    //! added to the tree (no matches for ineligible images)
+    //! @param[in] maximum_distance_matching_ the maximum distance allowed for a positive match
+    //! @param[in] image_filter_ eligible reference images (see ImageFilter)
+    void match(const MatchableVector& matchables_query_,
+               MatchVectorMap& matches_,
+               const uint32_t& maximum_distance_matching_,
+               const ImageFilter& image_filter_) const {
+      _matchPerImage(
+        MatchableQueries(matchables_query_), matches_, maximum_distance_matching_, &image_filter_);
+    }
+
+    //! @brief filtered knn multi-matching for raw query descriptors (no matchable allocation)
+    void match(const DescriptorQueries& descriptors_query_,
+               MatchVectorMap& matches_,
+               const uint32_t& maximum_distance_matching_,
+               const ImageFilter& image_filter_) const {
+      _matchPerImage(descriptors_query_, matches_, maximum_distance_matching_, &image_filter_);
+    }
+
+    //! @brief knn multi-matching function with a ratio test per reference image (see
+    //! matchWithRatio): best and second best distances are tracked for every image separately
+    //! @param[in] matchables_query_ query matchables
+    //! @param[out] matches_ output matching results: contains the unambiguous matches for all
+    //! training images added to the tree
+    //! @param[in] maximum_distance_matching_ the maximum distance allowed for a positive match
+    //! @param[in] ratio_ a best match is reported if its distance is below ratio_ times the second
+    //! best distance in the same image
+    void matchWithRatio(const MatchableVector& matchables_query_,
+                        MatchVectorMap& matches_,
+                        const uint32_t& maximum_distance_matching_ = 25,
+                        const real_type& ratio_                    = 0.8) const {
+      _matchPerImageWithRatio(
+        MatchableQueries(matchables_query_), matches_, maximum_distance_matching_, ratio_);
+    }
+
+    //! @brief per image matchWithRatio for raw query descriptors (no matchable allocation)
+    void matchWithRatio(const DescriptorQueries& descriptors_query_,
+                        MatchVectorMap& matches_,
+                        const uint32_t& maximum_distance_matching_ = 25,
+                        const real_type& ratio_                    = 0.8) const {
+      _matchPerImageWithRatio(descriptors_query_, matches_, maximum_distance_matching_, ratio_);
+    }
+
+    //! @brief knn multi-matching function with sparse output (see MatchBuffer)
+    //! @param[in] matchables_query_ query matchables
+    //! @param[out] matches_ output matching results: contains the matches of all training images
+    //! with at least one match
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    void match(const MatchableVector& matchables_query_,
+               MatchBuffer& matches_,
+               const uint32_t& maximum_distance_matching_ = 25) const {
+      _matchPerImage(MatchableQueries(matchables_query_), matches_, maximum_distance_matching_);
+    }
+
+    //! @brief knn multi-matching function with sparse output for raw query descriptors
+    void match(const DescriptorQueries& descriptors_query_,
+               MatchBuffer& matches_,
+               const uint32_t& maximum_distance_matching_ = 25) const {
+      _matchPerImage(descriptors_query_, matches_, maximum_distance_matching_);
+    }
+
     //! @brief incrementally grows the tree
     //! @param[in] matchables_ new input matchables to integrate into the current tree (transferring
     //! the ownership!)
@@ -564,24 +1043,18 @@ namespace srrg_hbst {
 
       // ds check if we have to build an initial tree first (no training afterwards)
       if (!_root) {
-        _root = new Node(_matchables_to_train, train_mode_);
+        _root = new Node(&_configuration, _matchables_to_train, train_mode_);
         assert(_matchables.empty());
         _matchables.insert(
           _matchables.end(), _matchables_to_train.begin(), _matchables_to_train.end());
         _header.number_of_matchables_compressed = _matchables_to_train.size();
         _matchables_to_train.clear();
+        _updateLinearStorage();
         return;
       }
 
-      // ds if random splitting is chosen
-      if (train_mode_ == SplittingStrategy::SplitRandomUniform) {
-        // ds initialize random number generator with new seed
-        std::random_device random_device;
-        Node::random_number_generator = std::mt19937(random_device());
-      }
-
       // ds nodes to update after the addition of matchables to leafs
-      std::set<Node*> leafs_to_update;
+      _leafs_to_update.clear();
 
 #ifdef SRRG_MERGE_DESCRIPTORS
       // ds we need delayed insertion as we continuously scan the current references for merging
@@ -592,7 +1065,7 @@ namespace srrg_hbst {
       _merged_matchables.reserve(_matchables_to_train.size());
 
       // ds currently we allow merging maximally once per reference matchable
-      std::set<const Matchable*> merged_reference_matchables;
+      _merged_reference_matchables.clear();
 #endif
 
       // ds for each new descriptor - buffering new matchables and merging identical ones
@@ -615,21 +1088,25 @@ namespace srrg_hbst {
             bool insertion_required = true;
 
             // ds if we can absorb this matchable instead of having to insert it
-            for (const Matchable* matchable_reference : node_current->matchables) {
-              // ds if merge distance is satisfied
-              // ds and this reference has not absorbed a matchable already in this call
-              if (matchable_reference->distance(matchable_to_insert) <=
-                    maximum_distance_for_merge &&
-                  merged_reference_matchables.count(matchable_reference) == 0) {
-                assert(matchable_reference != matchable_to_insert);
-                assert(matchable_to_insert->objects.size() == 1);
-                _merged_matchables.emplace_back(
-                  MatchableMerge(matchable_to_insert,
-                                 std::move(matchable_to_insert->_object),
-                                 const_cast<Matchable*>(matchable_reference)));
-                merged_reference_matchables.insert(matchable_reference);
-                insertion_required = false;
-                break;
+            if (node_current->getDistanceLowerBound(matchable_to_insert->descriptor) <=
+                _configuration.maximum_distance_for_merge) {
+              for (const Matchable* matchable_reference : node_current->getMatchables()) {
+                // ds if merge distance is satisfied
+                // ds and this reference has not absorbed a matchable already in this call
+                if (matchable_reference->distanceBounded(
+                      matchable_to_insert, _configuration.maximum_distance_for_merge) <=
+                      _configuration.maximum_distance_for_merge &&
+                    !_isMergedReference(matchable_reference)) {
+                  assert(matchable_reference != matchable_to_insert);
+                  assert(matchable_to_insert->objects.size() == 1);
+                  _merged_matchables.emplace_back(
+                    MatchableMerge(matchable_to_insert,
+                                   std::move(matchable_to_insert->_object),
+                                   const_cast<Matchable*>(matchable_reference)));
+                  _addMergedReference(matchable_reference);
+                  insertion_required = false;
+                  break;
+                }
               }
             }
 
@@ -644,13 +1121,15 @@ namespace srrg_hbst {
             }
 #else
             // ds we can place the descriptor in the leaf on the spot
-            node_current->matchables.push_back(matchable_to_insert);
+            node_current->addMatchable(matchable_to_insert);
+            _updateBitSummaries(node_current, matchable_to_insert->descriptor);
             _matchables_to_train[index_new_matchable] = matchable_to_insert;
             ++index_new_matchable;
 #endif
             // ds leaf always needs to be updated, merged or not
-            ++node_current->_header.number_of_matchables_uncompressed;
-            leafs_to_update.insert(node_current);
+            ++node_current->_getStorage()->header.number_of_matchables_uncompressed;
+            _updateImageRanges(node_current, matchable_to_insert->_image_identifier);
+            _leafs_to_update.push_back(node_current);
             break;
           }
         }
@@ -669,25 +1148,26 @@ namespace srrg_hbst {
         delete mergable.query;
       }
       _number_of_merged_matchables_last_training = _merged_matchables.size();
+      _number_of_merged_matchables_total += _merged_matchables.size();
       _merged_matchables.clear();
 
       // ds insert matchables into nodes
       _trainables.resize(index_new_matchable);
       assert(_matchables_to_train.size() == _trainables.size());
       for (const Trainable& trainable : _trainables) {
-        trainable.node->matchables.push_back(trainable.matchable);
+        trainable.node->addMatchable(trainable.matchable);
+        _updateBitSummaries(trainable.node, trainable.matchable->descriptor);
       }
 #endif
       // ds check splits for touched leafs
-      for (Node* leaf : leafs_to_update) {
-        leaf->spawnLeafs(train_mode_);
-      }
+      _spawnLeafs(train_mode_);
 
       // ds bookkeeping
       _matchables.insert(
         _matchables.end(), _matchables_to_train.begin(), _matchables_to_train.end());
       _header.number_of_matchables_compressed += _matchables_to_train.size();
       _matchables_to_train.clear();
+      _updateLinearStorage();
     }
 
     //! @brief knn multi-matching function with simultaneous adding
@@ -701,179 +1181,197 @@ namespace srrg_hbst {
                      MatchVectorMap& matches_,
                      const uint32_t maximum_distance_matching_ = 25,
                      const SplittingStrategy& train_mode_      = SplittingStrategy::SplitEven) {
-      if (matchables_.empty()) {
-        return;
-      }
-      const uint64_t identifier_image_query = matchables_.front()->_image_identifier;
+      _matchAndAdd(matchables_, &matches_, maximum_distance_matching_, train_mode_);
+    }
 
-      // ds check if we have to build an initial tree first
-      if (!_root) {
-        _root = new Node(matchables_);
-        assert(_matchables.empty());
-        _matchables.insert(_matchables.end(), matchables_.begin(), matchables_.end());
-        _header.number_of_matchables_compressed = matchables_.size();
-        _added_identifiers_train.insert(identifier_image_query);
-        assert(_added_identifiers_train.size() == 1);
-        _header.number_of_training_entries = 1;
-        return;
+    //! @brief knn multi-matching function with simultaneous adding and sparse output
+    //! @param[in] matchables_ query matchables, which will also automatically be added to the tree
+    //! (transferring the ownership!)
+    //! @param[out] matches_ output matching results: contains the matches of all training images
+    //! with at least one match (see MatchBuffer)
+    //! @param[in] maximum_distance_matching_ the maximum distance allowed for a positive match
+    //! response
+    void matchAndAdd(const MatchableVector& matchables_,
+                     MatchBuffer& matches_,
+                     const uint32_t maximum_distance_matching_ = 25,
+                     const SplittingStrategy& train_mode_      = SplittingStrategy::SplitEven) {
+      _matchAndAdd(matchables_, &matches_, maximum_distance_matching_, train_mode_);
+    }
+
+    //! @brief matchAndAdd with a per-track descent cache (results identical to matchAndAdd)
+    //! @param[in] matchables_ query matchables, which will also automatically be added to the tree
+    //! (transferring the ownership!)
+    //! @param[in] identifiers_track_ track identifier of each query (e.g. landmark identifier)
+    //! @param[in,out] track_cache_ descent cache, updated with the descents of the queries
+    //! @param[out] matches_ output matching results (MatchVectorMap or MatchBuffer)
+    //! @param[in] maximum_distance_matching_ the maximum distance allowed for a positive match
+    //! response
+    template <typename MatchOutputType_>
+    void matchAndAdd(const MatchableVector& matchables_,
+                     const std::vector<uint64_t>& identifiers_track_,
+                     TrackCache& track_cache_,
+                     MatchOutputType_& matches_,
+                     const uint32_t maximum_distance_matching_ = 25,
+                     const SplittingStrategy& train_mode_      = SplittingStrategy::SplitEven) {
+      assert(identifiers_track_.size() == matchables_.size());
+      _synchronizeTrackCache(track_cache_);
+      _matchAndAdd(matchables_,
+                   &matches_,
+                   maximum_distance_matching_,
+                   train_mode_,
+                   &track_cache_,
+                   identifiers_track_.data());
+    }
+
+    //! @brief thread-safe variant of add: multiple threads (e.g. one per robot or camera stream)
+    //! may insert into the same tree simultaneously. descents run in parallel, leaf insertions and
+    //! merges are guarded by striped per-leaf locks and overfull leafs are split afterwards with
+    //! exclusive access to the tree structure. only addConcurrent and matchAndAddConcurrent may
+    //! run concurrently - all other methods require external synchronization with them
+    //! @param[in] matchables_ new input matchables of a single image (transferring the ownership!)
+    //! @param[in] train_mode_ splitting strategy for overfull leafs
+    void addConcurrent(const MatchableVector& matchables_,
+                       const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) {
+      _addConcurrent(matchables_, train_mode_, nullptr, 0);
+    }
+
+    //! @brief thread-safe variant of matchAndAdd (see addConcurrent) - the queries are matched
+    //! against all references inserted before (including completed insertions of other threads)
+    //! @param[in] matchables_ query matchables, which will also automatically be added to the tree
+    //! (transferring the ownership!)
+    //! @param[out] matches_ output matching results (see MatchBuffer)
+    //! @param[in] maximum_distance_matching_ the maximum distance allowed for a positive match
+    //! response
+    //! @param[in] train_mode_ splitting strategy for overfull leafs
+    void
+    matchAndAddConcurrent(const MatchableVector& matchables_,
+                          MatchBuffer& matches_,
+                          const uint32_t maximum_distance_matching_ = 25,
+                          const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) {
+      _addConcurrent(matchables_, train_mode_, &matches_, maximum_distance_matching_);
+    }
+
+    //! @brief asynchronous variant of matchAndAdd: returns as soon as the queries are matched and
+    //! integrates them (insertion, merging and leaf splits) in a background stage. the matching
+    //! always sees all previously added matchables, i.e. a call waits for the background stage of
+    //! the previous call. other queries wait for it as well if Configuration::wait_for_insertion
+    //! is set (default), otherwise synchronize() has to be called before them. synchronize() is
+    //! always required before any other (modifying) access to the tree
+    //! @param[in] matchables_ query matchables, which will also automatically be added to the tree
+    //! (transferring the ownership! with SRRG_MERGE_DESCRIPTORS merged queries are freed in the
+    //! background stage)
+    //! @param[out] matches_ output matching results (MatchVectorMap or MatchBuffer), identical to
+    //! matchAndAdd
+    //! @param[in] maximum_distance_matching_ the maximum distance allowed for a positive match
+    //! response
+    //! @param[in] train_mode_ splitting strategy for touched leafs
+    template <typename MatchOutputType_>
+    void matchAndAddAsync(const MatchableVector& matchables_,
+                          MatchOutputType_& matches_,
+                          const uint32_t maximum_distance_matching_ = 25,
+                          const SplittingStrategy& train_mode_ = SplittingStrategy::SplitEven) {
+      synchronize();
+      _matchPerImage(MatchableQueries(matchables_), matches_, maximum_distance_matching_);
+
+      // ds integrate the matchables in the background with the insertion of matchAndAdd (the
+      // caller may release its vector)
+      _insertion = std::async(
+        std::launch::async, [this, matchables_, maximum_distance_matching_, train_mode_]() {
+          _matchAndAdd(matchables_,
+                       static_cast<MatchBuffer*>(nullptr),
+                       maximum_distance_matching_,
+                       train_mode_);
+        });
+    }
+
+    //! @brief waits for the background stage of the last matchAndAddAsync call (if any) and
+    //! forwards its exceptions
+    void synchronize() {
+      if (_insertion.valid()) {
+        _insertion.get();
       }
+    }
 
-      // ds prepare match vector map for all ids in the tree
-      matches_.clear();
-      for (const uint64_t identifier_tree : _added_identifiers_train) {
-        matches_.insert(std::make_pair(identifier_tree, MatchVector()));
+    //! @brief creates a matchable vector (pointers) from a contiguous raw descriptor buffer
+    //! (e.g. the descriptor matrix of an image, one descriptor per row) - no OpenCV required
+    //! @param[in] descriptors_ raw descriptor buffer
+    //! @param[in] number_of_descriptors_ number of descriptors (rows) in the buffer
+    //! @param[in] stride_bytes_ offset in bytes between two consecutive descriptors
+    //! @param[in] objects_ objects linked to the descriptors (one per descriptor)
+    //! @param[in] identifier_tree_ reference to image on which the descriptors have been computed
+    //! @returns matchables to be passed to the tree (which takes ownership)
+    static const MatchableVector getMatchables(const uint8_t* descriptors_,
+                                               const size_t& number_of_descriptors_,
+                                               const size_t& stride_bytes_,
+                                               const std::vector<ObjectType>& objects_,
+                                               const uint64_t& identifier_tree_ = 0) {
+      assert(objects_.size() == number_of_descriptors_);
+      assert(stride_bytes_ >= Matchable::raw_descriptor_size_bytes);
+      MatchableVector matchables(number_of_descriptors_);
 
-        // ds preallocate space to speed up match addition
-        matches_.at(identifier_tree).reserve(matchables_.size());
+      // ds copy raw data word-wise into the matchable descriptors
+      const uint8_t* descriptor_raw = descriptors_;
+      for (size_t index_descriptor = 0; index_descriptor < number_of_descriptors_;
+           ++index_descriptor) {
+        matchables[index_descriptor] = new Matchable(
+          objects_[index_descriptor], Matchable::getDescriptor(descriptor_raw), identifier_tree_);
+        descriptor_raw += stride_bytes_;
       }
+      return matchables;
+    }
 
-      // ds prepare node/matchable list to integrate
-      _trainables.resize(matchables_.size());
-      std::set<Node*> leafs_to_update;
+#ifdef SRRG_HBST_HAS_OPENCV
 
-#ifdef SRRG_MERGE_DESCRIPTORS
-      // ds matches to merge (descriptor distance == SRRG_MERGE_DESCRIPTORS)
-      _merged_matchables.clear();
-      _merged_matchables.reserve(matchables_.size());
+    // ds creates a matchable vector (pointers) from opencv descriptors - only available if OpenCV
+    // is present on building system
+    static const MatchableVector getMatchables(const cv::Mat& descriptors_cv_,
+                                               const std::vector<ObjectType>& objects_,
+                                               const uint64_t& identifier_tree_ = 0) {
+      return getMatchables(descriptors_cv_.data,
+                           descriptors_cv_.rows,
+                           descriptors_cv_.step,
+                           objects_,
+                           identifier_tree_);
+    }
 
-      // ds currently we allow merging maximally once per reference matchable
-      std::set<const Matchable*> merged_reference_matchables;
 #endif
 
-      // ds for each descriptor
-      uint64_t index_trainable = 0;
-      for (Matchable* matchable_query : matchables_) {
-        // ds traverse tree to find this descriptor
-        Node* node_current = _root;
-        while (node_current) {
-          // ds if this node has leaves (is splittable)
-          if (node_current->has_leafs) {
-            // ds check the split bit and go deeper
-            if (matchable_query->descriptor[node_current->index_split_bit]) {
-              node_current = node_current->right;
-            } else {
-              node_current = node_current->left;
-            }
-          } else {
-            // ds obtain best matches in the current leaf via brute-force search - bookkeeping
-            // matches to merge (distance == 0)
-            std::map<uint64_t, Match> best_matches;
-#ifdef SRRG_MERGE_DESCRIPTORS
-            Matchable* matchable_reference = nullptr;
-            _matchExhaustive(matchable_query,
-                             node_current->matchables,
-                             maximum_distance_matching_,
-                             best_matches,
-                             matchable_reference);
-#else
-            _matchExhaustive(
-              matchable_query, node_current->matchables, maximum_distance_matching_, best_matches);
-#endif
+    //! @brief splits pending leafs left over by a limited split budget (e.g. between frames)
+    //! @param[in] train_mode_ splitting strategy
+    //! @param[in] maximum_number_of_splits_ maximum number of leaf splits in this call
+    //! @returns number of leafs still pending
+    const size_t splitPendingLeafs(
+      const SplittingStrategy& train_mode_     = SplittingStrategy::SplitEven,
+      const size_t& maximum_number_of_splits_ = std::numeric_limits<size_t>::max()) {
+      _splitPendingLeafs(train_mode_, maximum_number_of_splits_);
+      return _leafs_to_split.size();
+    }
 
-            // ds register all matches in the output structure
-            for (const std::pair<uint64_t, Match> best_match : best_matches) {
-              matches_.at(best_match.first).push_back(best_match.second);
-            }
+    //! @brief clears complete structure (corresponds to empty construction)
+    void clear(const bool& delete_matchables_ = true) {
+      // ds a pending background insertion has to complete first (see matchAndAddAsync)
+      if (_insertion.valid()) {
+        _insertion.wait();
+      }
 
-#ifdef SRRG_MERGE_DESCRIPTORS
-            // ds if we can merge the query matchable into the reference
-            if (matchable_reference &&
-                merged_reference_matchables.count(matchable_reference) == 0) {
-              assert(matchable_query->objects.size() == 1);
+      // ds database identifier is not reset
 
-              // ds bookkeep matchable for merge
-              _merged_matchables.emplace_back(MatchableMerge(
-                matchable_query, std::move(matchable_query->_object), matchable_reference));
-              merged_reference_matchables.insert(matchable_reference);
-            } else {
-#endif
-              // ds bookkeep matchable for addition
-              _trainables[index_trainable].node      = node_current;
-              _trainables[index_trainable].matchable = matchable_query;
-              ++index_trainable;
+      // ds clean internal bookkeeping
+      _added_identifiers_train.clear();
+      _trainables.clear();
+      _leafs_to_split.clear();
+      _header.number_of_matchables_uncompressed = 0;
+      _header.number_of_matchables_compressed   = 0;
+      _header.number_of_training_entries        = 0;
 #ifdef SRRG_MERGE_DESCRIPTORS
-            }
+      _number_of_merged_matchables_last_training = 0;
+      _number_of_merged_matchables_total         = 0;
 #endif
 
-            // ds leaf needs to be updated, merged or not
-            ++node_current->_header.number_of_matchables_uncompressed;
-            leafs_to_update.insert(node_current);
-            break;
-          }
-        }
-      }
-      _trainables.resize(index_trainable);
-#ifdef SRRG_MERGE_DESCRIPTORS
-
-      // ds merge matchables
-      for (MatchableMerge& mergable : _merged_matchables) {
-        assert(mergable.reference != mergable.query);
-
-        // ds perform merge
-        mergable.reference->mergeSingle(mergable.query);
-
-        // ds free query (!) recall that the tree takes ownership of the matchables
-        delete mergable.query;
-      }
-      _number_of_merged_matchables_last_training = _merged_matchables.size();
-      _merged_matchables.clear();
-#endif
-
-      // ds integrate new matchables: merge, add and spawn leaves if requested
-      MatchableVector new_matchables;
-      new_matchables.reserve(_trainables.size());
-      for (const Trainable& trainable : _trainables) {
-        trainable.node->matchables.push_back(trainable.matchable);
-        new_matchables.emplace_back(trainable.matchable);
-      }
-      for (Node* leaf : leafs_to_update) {
-        leaf->spawnLeafs(train_mode_);
-      }
-
-      // ds insert new matchables and identifier
-      _matchables.insert(_matchables.end(), new_matchables.begin(), new_matchables.end());
-      _header.number_of_matchables_compressed += new_matchables.size();
-      _added_identifiers_train.insert(identifier_image_query);
-      ++_header.number_of_training_entries;
-    }
-
-#ifdef SRRG_HBST_HAS_OPENCV
-
-    // ds creates a matchable vector (pointers) from opencv descriptors - only available if OpenCV
-    // is present on building system
-    static const MatchableVector getMatchables(const cv::Mat& descriptors_cv_,
-                                               const std::vector<ObjectType>& objects_,
-                                               const uint64_t& identifier_tree_ = 0) {
-      MatchableVector matchables(descriptors_cv_.rows);
-
-      // ds copy raw data
-      for (int64_t index_descriptor = 0; index_descriptor < descriptors_cv_.rows;
-           ++index_descriptor) {
-        matchables[index_descriptor] = new Matchable(
-          objects_[index_descriptor], descriptors_cv_.row(index_descriptor), identifier_tree_);
-      }
-      return matchables;
-    }
-
-#endif
-
-    //! @brief clears complete structure (corresponds to empty construction)
-    void clear(const bool& delete_matchables_ = true) {
-      // ds database identifier is not reset
-
-      // ds clean internal bookkeeping
-      _added_identifiers_train.clear();
-      _trainables.clear();
-      _header.number_of_matchables_uncompressed = 0;
-      _header.number_of_matchables_compressed   = 0;
-      _header.number_of_training_entries        = 0;
-#ifdef SRRG_MERGE_DESCRIPTORS
-      _number_of_merged_matchables_last_training = 0;
-#endif
-
-      // ds recursively delete all nodes
+      // ds recursively delete all nodes (invalidates all track caches)
       delete _root;
-      _root = nullptr;
+      _root                 = nullptr;
+      _identifier_structure = _getNextIdentifierStructure();
 
       // ds ownership dependent
       if (delete_matchables_) {
@@ -881,6 +1379,8 @@ namespace srrg_hbst {
       }
       _matchables.clear();
       _matchables_to_train.clear();
+      delete _leaf_linear;
+      _leaf_linear = nullptr;
     }
 
     //! @brief free all matchables contained in the tree (destructor)
@@ -895,6 +1395,8 @@ namespace srrg_hbst {
 
     //! ds save complete database to disk
     bool write(const std::string& file_path) const {
+      _waitForInsertion();
+
       // ds open file (overwriting existing)
       std::ofstream outfile(file_path, std::ios::binary | std::ios::out);
       if (!outfile.is_open()) {
@@ -934,23 +1436,23 @@ namespace srrg_hbst {
 
       // ds write leaf information
       for (const Node* leaf : leafs) {
-        assert(leaf->_header.depth > 0);
+        assert(leaf->_getStorage()->header.depth > 0);
         assert(leaf->index_split_bit == -1);
         assert(leaf->has_leafs == false);
 #ifndef SRRG_MERGE_DESCRIPTORS
-        assert(leaf->_header.number_of_matchables_uncompressed ==
-               leaf->_header.number_of_matchables_compressed);
+        assert(leaf->_getStorage()->header.number_of_matchables_uncompressed ==
+               leaf->_getStorage()->header.number_of_matchables_compressed);
 #endif
         GUARDED_IO(outfile,
                    write,
-                   reinterpret_cast<const char*>(&leaf->_header),
-                   sizeof(leaf->_header),
+                   reinterpret_cast<const char*>(&leaf->_getStorage()->header),
+                   sizeof(leaf->_getStorage()->header),
                    "BinaryTree::write|ERROR: unable to write leaf header");
 
         // ds store split bit index order
         const Node* current = leaf;
         std::vector<int32_t> indices_split_bit;
-        indices_split_bit.reserve(leaf->_header.depth);
+        indices_split_bit.reserve(leaf->_getStorage()->header.depth);
         while (current) {
           indices_split_bit.emplace_back(current->index_split_bit);
           current = current->parent;
@@ -964,8 +1466,9 @@ namespace srrg_hbst {
         }
 
         // ds serialize matchables (descriptor) data
-        assert(leaf->_header.number_of_matchables_uncompressed >= leaf->matchables.size());
-        for (const Matchable* matchable : leaf->matchables) {
+        assert(leaf->_getStorage()->header.number_of_matchables_uncompressed >=
+               leaf->getMatchables().size());
+        for (const Matchable* matchable : leaf->getMatchables()) {
           GUARDED_IO(outfile,
                      write,
                      reinterpret_cast<const char*>(&matchable->descriptor),
@@ -977,7 +1480,7 @@ namespace srrg_hbst {
                      sizeof(uint64_t),
                      "BinaryTree::write|ERROR: unable to write number of objects");
           assert(matchable->number_of_objects == matchable->objects.size());
-          for (const ObjectMapElement& element : matchable->objects) {
+          for (const typename ObjectMap::value_type& element : matchable->objects) {
             GUARDED_IO(outfile,
                        write,
                        reinterpret_cast<const char*>(&element.first),
@@ -1122,7 +1625,9 @@ namespace srrg_hbst {
 
       // ds after this point we use dynamic memory to build the tree - no exceptions are thrown!
       // ds assemble actual database by evaluating all leafs
-      _root = new Node();
+      _root                 = new Node();
+      _identifier_structure = _getNextIdentifierStructure();
+      _leafs_to_split.clear();
       assert(leaf_headers.size() == bit_indexes_per_leaf.size());
       for (size_t i = 0; i < leaf_headers.size(); ++i) {
         const typename Node::Header& leaf_header             = leaf_headers[i];
@@ -1135,46 +1640,44 @@ namespace srrg_hbst {
         const Descriptor& descriptor_sample = descriptors.back();
 
         // ds start from root for each leaf
-        Node* current = _root;
+        Node* current  = _root;
+        uint64_t depth = 0;
         while (current) {
           // ds terminate if we reached a leaf
-          if (bit_index_order[current->_header.depth] == -1) {
-            assert(current->_header.depth == leaf_header.depth);
+          if (bit_index_order[depth] == -1) {
+            assert(depth == leaf_header.depth);
             assert(descriptors.size() == leaf_header.number_of_matchables_compressed);
 
-            // ds populate matchables of the leaf
-            assert(current->matchables.empty());
-            current->matchables.reserve(descriptors.size());
+            // ds populate matchables of the leaf (splitting mask derived from its path)
+            assert(!current->summary);
+            current->summary =
+              new typename Node::LeafStorage(&_configuration, depth, MatchableVector());
+            current->_getStorage()->matchables.reserve(descriptors.size());
+            current->_getStorage()->sketches.reserve(descriptors.size());
             for (size_t index_descriptor = 0; index_descriptor < descriptors.size();
                  ++index_descriptor) {
-              current->matchables.emplace_back(new Matchable(
-                objects_per_descriptor[index_descriptor], descriptors[index_descriptor]));
+              current->addMatchable(new Matchable(objects_per_descriptor[index_descriptor],
+                                                  descriptors[index_descriptor]));
             }
-            current->_header = std::move(leaf_header);
-            _matchables.insert(
-              _matchables.end(), current->matchables.begin(), current->matchables.end());
+            current->_getStorage()->header = leaf_header;
+            _matchables.insert(_matchables.end(),
+                               current->getMatchables().begin(),
+                               current->getMatchables().end());
             break;
           } else {
             // ds otherwise it is always an intermediate node
-            current->has_leafs = true;
-          }
-
-          // ds if this node has not been initialized yet
-          if (current->index_split_bit != bit_index_order[current->_header.depth]) {
-            current->index_split_bit                    = bit_index_order[current->_header.depth];
-            current->bit_mask[current->index_split_bit] = 0;
+            current->has_leafs       = true;
+            current->index_split_bit = bit_index_order[depth];
           }
 
           // ds spawn leafs if necessary (we have a complete tree)
           if (!current->right) {
-            current->right                = new Node();
-            current->right->_header.depth = current->_header.depth + 1;
-            current->right->parent        = current;
+            current->right         = new Node();
+            current->right->parent = current;
           }
           if (!current->left) {
-            current->left                = new Node();
-            current->left->_header.depth = current->_header.depth + 1;
-            current->left->parent        = current;
+            current->left         = new Node();
+            current->left->parent = current;
           }
 
           // ds traverse tree
@@ -1183,8 +1686,11 @@ namespace srrg_hbst {
           } else {
             current = current->left;
           }
+          ++depth;
         }
       }
+      _computeSummaries(_root);
+      _updateLinearStorage();
 
       // ds consistency check
       if (_matchables.size() != _header.number_of_matchables_compressed) {
@@ -1198,286 +1704,2487 @@ namespace srrg_hbst {
 
     // ds helpers
   protected:
-#ifdef SRRG_MERGE_DESCRIPTORS
-    //! @brief retrieves best matches (BF search) for provided matchables for all image indices
-    //! @param[in] matchable_query_
-    //! @param[in] matchables_reference_
-    //! @param[in] maximum_distance_matching_
-    //! @param[in,out] best_matches_ best match search storage: image id, match candidate
-    void _matchExhaustive(const Matchable* matchable_query_,
-                          const MatchableVector& matchables_reference_,
-                          const uint32_t& maximum_distance_matching_,
-                          std::map<uint64_t, Match>& best_matches_) const {
-      ObjectType object_query =
-        std::move(matchable_query_->objects.at(matchable_query_->_image_identifier));
+    //! @brief reference tied with a best match candidate (see BestMatchVector)
+    struct BestMatchTie {
+      size_t index_best_match;
+      uint32_t distance;
+      MatchReference reference;
+    };
 
-      // ds check current descriptors in this node
-      for (const Matchable* matchable_reference : matchables_reference_) {
-        // ds compute the descriptor distance
-        const uint32_t distance = matchable_query_->distance(matchable_reference);
+    //! @brief best match candidates of a single query: image id, match candidate (few entries)
+    //! and the references tied with them - ties of replaced candidates are outdated (larger
+    //! distance) and skipped on output
+    struct BestMatchVector {
+      void clear() {
+        matches.clear();
+        ties.clear();
+      }
+      std::vector<std::pair<uint64_t, Match>> matches;
+      std::vector<BestMatchTie> ties;
+    };
 
-        // ds if matching distance is within the threshold
-        if (distance < maximum_distance_matching_) {
-          // ds for every reference in this matchable
-          for (const ObjectMapElement& object : matchable_reference->objects) {
-            const uint64_t& identifer_tree_reference = object.first;
+    //! @brief best match candidate of a single query in a reference image, with the second best
+    //! distance in that image (see matchWithRatio) - no best match if matchable_reference is unset
+    struct RatioCandidate {
+      uint64_t identifier_reference;
+      Match match;
+      uint32_t distance_second;
+    };
+    typedef std::vector<RatioCandidate> RatioCandidateVector;
+
+    //! @brief unexplored subtree of a best-first search (see matchExact)
+    struct FrontierNode {
+      uint32_t distance_lower_bound;
+      uint32_t number_of_mismatched_split_bits;
+      const Node* node;
+      bool operator>(const FrontierNode& other_) const {
+        return distance_lower_bound > other_.distance_lower_bound;
+      }
+    };
 
-            try {
-              // ds update match if current is better than the current best - will jump to addition
-              // if no best is available
-              Match& best_match_so_far              = best_matches_.at(identifer_tree_reference);
-              const real_type& best_distance_so_far = best_match_so_far.distance;
-              assert(best_distance_so_far >= 0);
-              if (distance < best_distance_so_far) {
-                assert(best_match_so_far.matchable_references.size() >= 1);
-                assert(best_match_so_far.object_references.size() >= 1);
-
-                // ds replace the best with this match on the spot - we don't have to update the
-                // query information
-                best_match_so_far.matchable_references =
-                  std::move(std::vector<const Matchable*>(1, matchable_reference));
-                best_match_so_far.object_references =
-                  std::move(std::vector<ObjectType>(1, object.second));
-                best_match_so_far.distance = distance;
-                assert(best_match_so_far.matchable_references.size() == 1);
-                assert(best_match_so_far.object_references.size() == 1);
-              }
+    //! @brief query access on a matchable vector (same interface as DescriptorQueries)
+    struct MatchableQueries {
+      MatchableQueries(const MatchableVector& matchables_) : matchables(matchables_) {
+      }
+      size_t size() const {
+        return matchables.size();
+      }
+      const Descriptor& descriptor(const size_t& index_) const {
+        return matchables[index_]->descriptor;
+      }
+      const Matchable* matchable(const size_t& index_) const {
+        return matchables[index_];
+      }
+      const ObjectType& object(const size_t& index_) const {
+        return matchables[index_]->objects.begin()->second;
+      }
+      const MatchableVector& matchables;
 
-              // ds if the match is equal to the last (multiple candidates)
-              else if (distance == best_distance_so_far) {
-                // ds add the candidate - we don't have to update the distance since its the same as
-                // the best
-                best_match_so_far.matchable_references.push_back(matchable_reference);
-                best_match_so_far.object_references.push_back(object.second);
-                assert(best_match_so_far.matchable_references.size() > 1);
-                assert(best_match_so_far.object_references.size() > 1);
-              }
-            } catch (const std::out_of_range& /*exception*/) {
-              // ds add a new match
-              best_matches_.insert(std::make_pair(
-                identifer_tree_reference,
-                Match(
-                  matchable_query_, matchable_reference, object_query, object.second, distance)));
-            }
-          }
-        }
+      //! @brief no per-track descent cache (see TrackedQueries)
+      static constexpr bool tracked = false;
+      TrackDescent* track(const size_t& /*index_*/) const {
+        return nullptr;
+      }
+    };
+
+    //! @brief query access with a per-track descent cache (see TrackCache)
+    template <typename QueriesType_>
+    struct TrackedQueries : public QueriesType_ {
+      TrackedQueries(const QueriesType_& queries_,
+                     const uint64_t* identifiers_track_,
+                     TrackCache& track_cache_) :
+        QueriesType_(queries_),
+        identifiers_track(identifiers_track_),
+        track_cache(track_cache_) {
+      }
+      static constexpr bool tracked = true;
+      TrackDescent* track(const size_t& index_) const {
+        return &track_cache.tracks[identifiers_track[index_]];
       }
+      const uint64_t* identifiers_track;
+      TrackCache& track_cache;
+    };
+
+    //! @brief wraps queries with a per-track descent cache, which is flushed if outdated
+    template <typename QueriesType_>
+    TrackedQueries<QueriesType_> _getTrackedQueries(const QueriesType_& queries_,
+                                                    const std::vector<uint64_t>& identifiers_track_,
+                                                    TrackCache& track_cache_) const {
+      assert(identifiers_track_.size() == queries_.size());
+      _synchronizeTrackCache(track_cache_);
+      return TrackedQueries<QueriesType_>(queries_, identifiers_track_.data(), track_cache_);
     }
 
-    //! @brief retrieves best matches (BF search) for provided matchables for all image indices
-    //! @param[in] matchable_query_
-    //! @param[in] matchables_reference_
-    //! @param[in] maximum_distance_matching_
-    //! @param[in,out] best_matches_ best match search storage: image id, match candidate
-    //! @param[in,out] matchable_reference_for_merge_ reference matchable with distance == 0
-    //! (matchable merge candidate)
-    void _matchExhaustive(const Matchable* matchable_query_,
-                          const MatchableVector& matchables_reference_,
-                          const uint32_t& maximum_distance_matching_,
-                          std::map<uint64_t, Match>& best_matches_,
-                          Matchable*& matchable_reference_for_merge_) const {
-      ObjectType object_query =
-        std::move(matchable_query_->objects.at(matchable_query_->_image_identifier));
+    //! @brief flushes a track cache that was filled on another tree or before a clear
+    void _synchronizeTrackCache(TrackCache& track_cache_) const {
+      if (track_cache_.identifier_structure != _identifier_structure) {
+        track_cache_.tracks.clear();
+        track_cache_.identifier_structure = _identifier_structure;
+      }
+    }
 
-      // ds check current descriptors in this node
-      for (const Matchable* matchable_reference : matchables_reference_) {
-        // ds compute the descriptor distance
-        const uint32_t distance = matchable_query_->distance(matchable_reference);
+    //! @brief descent start of a tracked query: the cached leaf if the descriptor agrees with all
+    //! split bits on the cached path, the root otherwise (resets the path)
+    //! @param[in,out] track_ cached descent of the track
+    //! @param[in] descriptor_ query descriptor
+    //! @returns node to start the descent from
+    const Node* _getTrackStart(TrackDescent& track_, const Descriptor& descriptor_) const {
+      if (track_.leaf && ((descriptor_ ^ track_.path_bits) & track_.path_mask).none()) {
+        return track_.leaf;
+      }
+      track_.path_mask.reset();
+      return _root;
+    }
 
-        // ds if matching distance is within the threshold
-        if (distance < maximum_distance_matching_) {
-          // ds for every reference in this matchable
-          for (const ObjectMapElement& object : matchable_reference->objects) {
-            const uint64_t& identifer_tree_reference = object.first;
+    //! @brief caches the destination leaf of a tracked query (the path mask is set on descent)
+    static void _setTrackLeaf(TrackDescent& track_,
+                              const Node* leaf_,
+                              const Descriptor& descriptor_) {
+      track_.leaf      = leaf_;
+      track_.path_bits = descriptor_ & track_.path_mask;
+    }
 
-            try {
-              // ds update match if current is better than the current best - will jump to addition
-              // if no best is available
-              Match& best_match_so_far              = best_matches_.at(identifer_tree_reference);
-              const real_type& best_distance_so_far = best_match_so_far.distance;
-              assert(best_distance_so_far >= 0);
-              if (distance < best_distance_so_far) {
-                assert(best_match_so_far.matchable_references.size() >= 1);
-                assert(best_match_so_far.object_references.size() >= 1);
-
-                // ds replace the best with this match on the spot - we don't have to update the
-                // query information
-                best_match_so_far.matchable_references =
-                  std::move(std::vector<const Matchable*>(1, matchable_reference));
-                best_match_so_far.object_references =
-                  std::move(std::vector<ObjectType>(1, object.second));
-                best_match_so_far.distance = distance;
-                assert(best_match_so_far.matchable_references.size() == 1);
-                assert(best_match_so_far.object_references.size() == 1);
-              }
+    //! @brief unique structure identifier for every built tree (see TrackCache)
+    static uint64_t _getNextIdentifierStructure() {
+      static std::atomic<uint64_t> identifier_structure_next(1);
+      return identifier_structure_next++;
+    }
 
-              // ds if the match is equal to the last (multiple candidates)
-              else if (distance == best_distance_so_far) {
-                // ds add the candidate - we don't have to update the distance since its the same as
-                // the best
-                best_match_so_far.matchable_references.push_back(matchable_reference);
-                best_match_so_far.object_references.push_back(object.second);
-                assert(best_match_so_far.matchable_references.size() > 1);
-                assert(best_match_so_far.object_references.size() > 1);
-              }
-            } catch (const std::out_of_range& /*exception*/) {
-              // ds add a new match
-              best_matches_.insert(std::make_pair(
-                identifer_tree_reference,
-                Match(
-                  matchable_query_, matchable_reference, object_query, object.second, distance)));
+    //! @brief appends the matchables added since the last call to the linear search leaf - the
+    //! leaf is released once the tree outgrows the linear search threshold (see Configuration)
+    void _updateLinearStorage() {
+      if (_matchables.size() >= _configuration.maximum_number_of_matchables_linear_search) {
+        delete _leaf_linear;
+        _leaf_linear = nullptr;
+        return;
+      }
+
+      // ds the leaf never splits (maximum depth 0) and does not own its matchables
+      if (!_leaf_linear) {
+        _configuration_linear.maximum_depth = 0;
+        _leaf_linear = new Node(&_configuration_linear, MatchableVector());
+      }
+      for (size_t index_matchable = _leaf_linear->getMatchables().size();
+           index_matchable < _matchables.size();
+           ++index_matchable) {
+        _leaf_linear->addMatchable(_matchables[index_matchable]);
+        _leaf_linear->updateBitSummaries(_matchables[index_matchable]->descriptor);
+      }
+
+      // ds merged references gain images without being appended - the range covers all images
+      if (!_added_identifiers_train.empty()) {
+        _leaf_linear->updateImageRange(*_added_identifiers_train.begin());
+        _leaf_linear->updateImageRange(*_added_identifiers_train.rbegin());
+      }
+    }
+
+    //! @brief checks whether queries are answered by linear search (leaf in sync)
+    bool _isSearchLinear() const {
+      return _leaf_linear && !_matchables.empty() &&
+             _matchables.size() < _configuration.maximum_number_of_matchables_linear_search &&
+             _leaf_linear->getMatchables().size() == _matchables.size();
+    }
+
+    //! @brief node at which all queries start: the root, or the linear search leaf holding all
+    //! matchables for small trees - every query path scans it like a single-leaf tree
+    const Node* _getRootSearch() const {
+      return _isSearchLinear() ? _leaf_linear : _root;
+    }
+
+    //! @brief counts queries with a reference within maximum_distance_ (see getNumberOfMatches)
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @returns number of matched queries
+    template <typename QueriesType_>
+    const uint64_t _getNumberOfMatches(const QueriesType_& queries_,
+                                       const uint32_t& maximum_distance_) const {
+      _waitForInsertion();
+      if (queries_.size() == 0 || !_root) {
+        return 0;
+      }
+      uint64_t number_of_matches             = 0;
+      const uint32_t maximum_distance_sketch = _getMaximumDistanceSketch(maximum_distance_);
+
+      // ds for each group of descriptors
+      const Node* leafs[number_of_queries_interleaved];
+      for (size_t index_begin = 0; index_begin < queries_.size();
+           index_begin += number_of_queries_interleaved) {
+        const size_t index_end =
+          std::min(index_begin + number_of_queries_interleaved, queries_.size());
+
+        // ds traverse tree to find the leafs of all descriptors in the group at once
+        _descend(queries_, index_begin, index_end, leafs);
+        for (size_t index_query = index_begin; index_query < index_end; ++index_query) {
+          const Descriptor& descriptor_query = queries_.descriptor(index_query);
+          const Node* leaf                   = leafs[index_query - index_begin];
+          if (leaf->getDistanceLowerBound(descriptor_query) >= maximum_distance_) {
+            continue;
+          }
+
+          // ds check current descriptors in this leaf
+          const uint64_t sketch_query = Matchable::getSketch(descriptor_query);
+          for (size_t index_reference = 0; index_reference < leaf->getMatchables().size();
+               ++index_reference) {
+            if (!_isWithinSketchDistance(
+                  sketch_query, leaf->getSketches()[index_reference], maximum_distance_sketch)) {
+              continue;
+            }
+            const Matchable* matchable_reference = leaf->getMatchables()[index_reference];
+            if (maximum_distance_ > Matchable::distanceBounded(descriptor_query,
+                                                               matchable_reference->descriptor,
+                                                               maximum_distance_)) {
+              ++number_of_matches;
+              break;
             }
           }
+        }
+      }
+      return number_of_matches;
+    }
 
-          // ds if the matchable descriptors are identical - we can merge - note that
-          // maximum_distance_for_merge must always be smaller than maximum_distance_matching_
-          assert(maximum_distance_for_merge < maximum_distance_matching_);
-          if (distance <= maximum_distance_for_merge) {
-            // ds behold the power of C++ (we want to keep the MatchableVector elements const)
-            matchable_reference_for_merge_ = const_cast<Matchable*>(matchable_reference);
+    //! @brief counts queries whose first leaf reference is within maximum_distance_
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @returns number of matched queries
+    template <typename QueriesType_>
+    const uint64_t _getNumberOfMatchesLazy(const QueriesType_& queries_,
+                                           const uint32_t& maximum_distance_) const {
+      _waitForInsertion();
+      if (queries_.size() == 0 || !_root) {
+        return 0;
+      }
+      uint64_t number_of_matches = 0;
+
+      // ds for each group of descriptors
+      const Node* leafs[number_of_queries_interleaved];
+      for (size_t index_begin = 0; index_begin < queries_.size();
+           index_begin += number_of_queries_interleaved) {
+        const size_t index_end =
+          std::min(index_begin + number_of_queries_interleaved, queries_.size());
+
+        // ds traverse tree to find the leafs of all descriptors in the group at once
+        _descend(queries_, index_begin, index_end, leafs);
+        for (size_t index_query = index_begin; index_query < index_end; ++index_query) {
+          const Node* leaf = leafs[index_query - index_begin];
+
+          // ds check the first descriptor in this leaf
+          if (maximum_distance_ >
+              Matchable::distanceBounded(queries_.descriptor(index_query),
+                                         leaf->getMatchables().front()->descriptor,
+                                         maximum_distance_)) {
+            ++number_of_matches;
           }
         }
       }
+      return number_of_matches;
     }
-#else
-    //! @brief retrieves best matches (BF search) for provided matchables for all image indices
-    //! @param[in] matchable_query_
-    //! @param[in] matchables_reference_
-    //! @param[in] maximum_distance_matching_
-    //! @param[in,out] best_matches_ best match search storage: image id, match candidate
-    void _matchExhaustive(const Matchable* matchable_query_,
-                          const MatchableVector& matchables_reference_,
-                          const uint32_t& maximum_distance_matching_,
-                          std::map<uint64_t, Match>& best_matches_) const {
-      ObjectType object_query =
-        std::move(matchable_query_->objects.at(matchable_query_->_image_identifier));
 
-      // ds check current descriptors in this node
-      for (const Matchable* matchable_reference : matchables_reference_) {
-        // ds compute the descriptor distance
-        const uint32_t distance = matchable_query_->distance(matchable_reference);
+    //! @brief scores all trained images (see getScorePerImage)
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[in] sort_output_ sort scores in descending order by matching ratio
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] image_filter_ optional eligible reference images (see ImageFilter)
+    //! @returns a score for every (eligible) trained image
+    template <typename QueriesType_>
+    const ScoreVector _getScorePerImage(const QueriesType_& queries_,
+                                        const bool& sort_output_,
+                                        const uint32_t& maximum_distance_,
+                                        const ImageFilter* image_filter_ = nullptr) const {
+      _waitForInsertion();
+      if (queries_.size() == 0) {
+        return ScoreVector(0);
+      }
+      ScoreVector scores_per_image;
+      scores_per_image.reserve(_added_identifiers_train.size());
 
-        // ds if matching distance is within the threshold
-        if (distance < maximum_distance_matching_) {
-          const uint64_t& identifer_tree_reference = matchable_reference->_image_identifier;
-          assert(matchable_reference->objects.find(identifer_tree_reference) !=
-                 matchable_reference->objects.end());
-          ObjectType object_reference =
-            std::move(matchable_reference->objects.at(identifer_tree_reference));
+      // ds identifier to vector index mapping - simultaneously initialize result vector
+      std::map<uint64_t, uint64_t> mapping_identifier_image_to_score;
+      for (const uint64_t& identifier_reference : _added_identifiers_train) {
+        if (image_filter_ && !image_filter_->isEligible(identifier_reference)) {
+          continue;
+        }
+        scores_per_image.emplace_back();
+        scores_per_image.back().identifier_reference = identifier_reference;
+        mapping_identifier_image_to_score.insert(
+          std::make_pair(identifier_reference, mapping_identifier_image_to_score.size()));
+      }
 
-          try {
-            // ds update match if current is better than the current best - will jump to addition if
-            // no best is available
-            Match& best_match_so_far = best_matches_.at(identifer_tree_reference);
-            const real_type& best_distance_so_far = best_match_so_far.distance;
-            assert(best_distance_so_far >= 0);
-            if (distance < best_distance_so_far) {
-              assert(best_match_so_far.matchable_references.size() >= 1);
-              assert(best_match_so_far.object_references.size() >= 1);
-
-              // ds replace the best with this match on the spot - we don't have to update the query
-              // information
-              best_match_so_far.matchable_references =
-                std::move(std::vector<const Matchable*>(1, matchable_reference));
-              best_match_so_far.object_references =
-                std::move(std::vector<ObjectType>(1, object_reference));
-              best_match_so_far.distance = distance;
-              assert(best_match_so_far.matchable_references.size() == 1);
-              assert(best_match_so_far.object_references.size() == 1);
+      // ds for each group of query descriptors (if there are references)
+      if (_root) {
+        const uint32_t maximum_distance_sketch = _getMaximumDistanceSketch(maximum_distance_);
+        const Node* leafs[number_of_queries_interleaved];
+        for (size_t index_begin = 0; index_begin < queries_.size();
+             index_begin += number_of_queries_interleaved) {
+          const size_t index_end =
+            std::min(index_begin + number_of_queries_interleaved, queries_.size());
+
+          // ds traverse tree to find the leafs of all descriptors in the group at once
+          _descend(queries_, index_begin, index_end, leafs);
+          for (size_t index_query = index_begin; index_query < index_end; ++index_query) {
+            const Descriptor& descriptor_query = queries_.descriptor(index_query);
+            const Node* leaf                   = leafs[index_query - index_begin];
+            if (leaf->getDistanceLowerBound(descriptor_query) >= maximum_distance_ ||
+                (image_filter_ && !_isEligible(*image_filter_, leaf))) {
+              continue;
             }
 
-            // ds if the match is equal to the last (multiple candidates)
-            else if (distance == best_distance_so_far) {
-              // ds add the candidate - we don't have to update the distance since its the same as
-              // the best
-              best_match_so_far.matchable_references.push_back(matchable_reference);
-              best_match_so_far.object_references.push_back(object_reference);
-              assert(best_match_so_far.matchable_references.size() > 1);
-              assert(best_match_so_far.object_references.size() > 1);
+            // ds check current descriptors for each reference image in this leaf
+            std::set<uint64_t> matched_references;
+            const uint64_t sketch_query = Matchable::getSketch(descriptor_query);
+            for (size_t index_reference = 0; index_reference < leaf->getMatchables().size();
+                 ++index_reference) {
+              if (!_isWithinSketchDistance(
+                    sketch_query, leaf->getSketches()[index_reference], maximum_distance_sketch)) {
+                continue;
+              }
+              const Matchable* matchable_reference = leaf->getMatchables()[index_reference];
+              if (image_filter_ && !_isEligible(*image_filter_, matchable_reference)) {
+                continue;
+              }
+              if (Matchable::distanceBounded(
+                    descriptor_query, matchable_reference->descriptor, maximum_distance_) <
+                  maximum_distance_) {
+#ifdef SRRG_MERGE_DESCRIPTORS
+                for (const typename ObjectMap::value_type& object : matchable_reference->objects) {
+                  const uint64_t& identifier_reference = object.first;
+                  if (image_filter_ && !image_filter_->isEligible(identifier_reference)) {
+                    continue;
+                  }
+#else
+                const uint64_t& identifier_reference = matchable_reference->_image_identifier;
+#endif
+
+                  // ds the query matchable can be matched only once to each reference image
+                  if (matched_references.count(identifier_reference) == 0) {
+                    ++scores_per_image[mapping_identifier_image_to_score.at(identifier_reference)]
+                        .number_of_matches;
+                    matched_references.insert(identifier_reference);
+                  }
+#ifdef SRRG_MERGE_DESCRIPTORS
+                }
+#endif
+              }
             }
-          } catch (const std::out_of_range& /*exception*/) {
-            // ds add a new match
-            best_matches_.insert(std::make_pair(
-              identifer_tree_reference,
-              Match(
-                matchable_query_, matchable_reference, object_query, object_reference, distance)));
           }
         }
       }
-    }
-#endif
 
-    //! @brief recursively counts all leafs and descriptors stored in the tree (expensive)
-    //! @param[in] starting node (only subtree will be evaluated)
-    //! @param[out] number_of_leafs_
-    //! @param[out] number_of_matchables_
-    //! @param[out] leafs_
-    void _getLeafs(Node* node_,
-                   uint64_t& number_of_leafs_,
-                   uint64_t& number_of_matchables_,
-                   std::vector<const Node*>& leafs_) const {
-      // ds handle call on empty tree without node_ == _root
-      if (_root == nullptr) {
-        number_of_leafs_      = 0;
-        number_of_matchables_ = 0;
-        leafs_.clear();
-        return;
+      // ds compute relative scores
+      const real_type number_of_query_descriptors = queries_.size();
+      for (Score& score : scores_per_image) {
+        score.matching_ratio = score.number_of_matches / number_of_query_descriptors;
       }
 
-      // ds if we are in a node (that has leafs)
-      if (node_->has_leafs) {
-        assert(node_->right);
-        assert(node_->left);
+      // ds if desired, sort in descending order by matching ratio
+      if (sort_output_) {
+        std::sort(
+          scores_per_image.begin(), scores_per_image.end(), [](const Score& a, const Score& b) {
+            return a.matching_ratio > b.matching_ratio;
+          });
+      }
+      return scores_per_image;
+    }
 
-        // ds look deeper on left and right subtree
-        _getLeafs(node_->left, number_of_leafs_, number_of_matchables_, leafs_);
-        _getLeafs(node_->right, number_of_leafs_, number_of_matchables_, leafs_);
+    //! @brief retrieves the K best scoring reference images (see getTopKImages)
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[in] number_of_images_ the desired number of best images K
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] number_of_threads_ number of threads used for vote accumulation
+    //! @param[in] image_filter_ optional eligible reference images (see ImageFilter)
+    //! @returns at most K scores, sorted in descending order by matching ratio
+    template <typename QueriesType_>
+    const ScoreVector _getTopKImages(const QueriesType_& queries_,
+                                     const size_t& number_of_images_,
+                                     const uint32_t& maximum_distance_,
+                                     const size_t& number_of_threads_,
+                                     const ImageFilter* image_filter_ = nullptr) const {
+      _waitForInsertion();
+      if (queries_.size() == 0 || number_of_images_ == 0 || !_root) {
+        return ScoreVector(0);
+      }
 
+      // ds accumulate votes in a histogram per thread over contiguous query ranges
+      const size_t number_of_threads =
+        std::max(static_cast<size_t>(1), std::min(number_of_threads_, queries_.size()));
+      const size_t number_of_queries_per_thread =
+        (queries_.size() + number_of_threads - 1) / number_of_threads;
+      std::vector<VoteHistogram> votes_per_thread(number_of_threads);
+      if (number_of_threads == 1) {
+        _accumulateVotes(
+          queries_, 0, queries_.size(), maximum_distance_, votes_per_thread[0], image_filter_);
       } else {
-        // ds we reached a leaf
-        assert(!node_->right);
-        assert(!node_->left);
+        std::vector<std::thread> workers;
+        workers.reserve(number_of_threads);
+        for (size_t index_thread = 0; index_thread < number_of_threads; ++index_thread) {
+          const size_t index_begin = index_thread * number_of_queries_per_thread;
+          const size_t index_end =
+            std::min(index_begin + number_of_queries_per_thread, queries_.size());
+          workers.emplace_back([&, index_thread, index_begin, index_end]() {
+            _accumulateVotes(queries_,
+                             index_begin,
+                             index_end,
+                             maximum_distance_,
+                             votes_per_thread[index_thread],
+                             image_filter_);
+          });
+        }
+        for (std::thread& worker : workers) {
+          worker.join();
+        }
+      }
 
-        // ds update statistics and terminate recursion
-        ++number_of_leafs_;
-        number_of_matchables_ += node_->matchables.size();
-        leafs_.push_back(node_);
+      // ds reduce thread histograms into the first one
+      VoteHistogram& votes = votes_per_thread[0];
+      for (size_t index_thread = 1; index_thread < number_of_threads; ++index_thread) {
+        for (const std::pair<const uint64_t, Vote>& vote : votes_per_thread[index_thread]) {
+          votes[vote.first].number_of_matches += vote.second.number_of_matches;
+        }
       }
-    }
+
+      // ds only images that received votes are scored
+      ScoreVector scores;
+      scores.reserve(votes.size());
+      const real_type number_of_query_descriptors = queries_.size();
+      for (const std::pair<const uint64_t, Vote>& vote : votes) {
+        Score score;
+        score.number_of_matches    = vote.second.number_of_matches;
+        score.matching_ratio       = score.number_of_matches / number_of_query_descriptors;
+        score.identifier_reference = vote.first;
+        scores.emplace_back(score);
+      }
+
+      // ds partial selection of the K best images (ties resolved by image identifier)
+      const size_t number_of_images = std::min(number_of_images_, scores.size());
+      std::partial_sort(scores.begin(),
+                        scores.begin() + number_of_images,
+                        scores.end(),
+                        [](const Score& a, const Score& b) {
+                          return a.number_of_matches > b.number_of_matches ||
+                                 (a.number_of_matches == b.number_of_matches &&
+                                  a.identifier_reference < b.identifier_reference);
+                        });
+      scores.resize(number_of_images);
+      return scores;
+    }
+
+    //! @brief retrieves the first reference within maximum_distance_ per query (see matchLazy)
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[out] matches_ output matching results
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    template <typename QueriesType_>
+    void _matchLazy(const QueriesType_& queries_,
+                    MatchVector& matches_,
+                    const uint32_t& maximum_distance_) const {
+      _waitForInsertion();
+      _matchLazyVisit(queries_,
+                      maximum_distance_,
+                      [&matches_, &queries_](const size_t& index_query_,
+                                             const Matchable* matchable_reference_,
+                                             const uint32_t& distance_) {
+                        matches_.push_back(Match(queries_.matchable(index_query_),
+                                                 matchable_reference_,
+                                                 queries_.object(index_query_),
+                                                 matchable_reference_->objects.begin()->second,
+                                                 distance_));
+                      });
+    }
+
+    //! @brief visits the first reference within maximum_distance_ per query (see matchLazy)
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] visitor_ callable (index_query, matchable_reference, distance)
+    template <typename QueriesType_, typename VisitorType_>
+    void _matchLazyVisit(const QueriesType_& queries_,
+                         const uint32_t& maximum_distance_,
+                         VisitorType_&& visitor_) const {
+      _waitForInsertion();
+      if (queries_.size() == 0 || !_root) {
+        return;
+      }
+      const uint32_t maximum_distance_sketch = _getMaximumDistanceSketch(maximum_distance_);
+
+      // ds for each group of descriptors
+      const Node* leafs[number_of_queries_interleaved];
+      for (size_t index_begin = 0; index_begin < queries_.size();
+           index_begin += number_of_queries_interleaved) {
+        const size_t index_end =
+          std::min(index_begin + number_of_queries_interleaved, queries_.size());
+
+        // ds traverse tree to find the leafs of all descriptors in the group at once
+        _descend(queries_, index_begin, index_end, leafs);
+        for (size_t index_query = index_begin; index_query < index_end; ++index_query) {
+          const Descriptor& descriptor_query = queries_.descriptor(index_query);
+          const Node* leaf                   = leafs[index_query - index_begin];
+          if (leaf->getDistanceLowerBound(descriptor_query) >= maximum_distance_) {
+            continue;
+          }
+
+          // ds check current descriptors in this leaf
+          const uint64_t sketch_query = Matchable::getSketch(descriptor_query);
+          for (size_t index_reference = 0; index_reference < leaf->getMatchables().size();
+               ++index_reference) {
+            if (!_isWithinSketchDistance(
+                  sketch_query, leaf->getSketches()[index_reference], maximum_distance_sketch)) {
+              continue;
+            }
+            const Matchable* matchable_reference = leaf->getMatchables()[index_reference];
+            const uint32_t distance              = Matchable::distanceBounded(
+              descriptor_query, matchable_reference->descriptor, maximum_distance_);
+            if (distance < maximum_distance_) {
+              visitor_(index_query, matchable_reference, distance);
+              break;
+            }
+          }
+        }
+      }
+    }
+
+    //! @brief retrieves the best reference within maximum_distance_ per query (see match)
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[out] matches_ output matching results
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] image_filter_ optional eligible reference images (see ImageFilter)
+    template <typename QueriesType_>
+    void _match(const QueriesType_& queries_,
+                MatchVector& matches_,
+                const uint32_t& maximum_distance_,
+                const ImageFilter* image_filter_ = nullptr) const {
+      _waitForInsertion();
+      _matchVisit(
+        queries_,
+        maximum_distance_,
+        [&matches_, &queries_, image_filter_](const size_t& index_query_,
+                                              const Matchable* matchable_reference_,
+                                              const uint32_t& distance_) {
+          matches_.push_back(Match(queries_.matchable(index_query_),
+                                   matchable_reference_,
+                                   queries_.object(index_query_),
+                                   _getObject(matchable_reference_, image_filter_),
+                                   distance_));
+        },
+        image_filter_);
+    }
+
+    //! @brief visits the best reference within maximum_distance_ per query (see match)
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] visitor_ callable (index_query, matchable_reference, distance)
+    //! @param[in] image_filter_ optional eligible reference images (see ImageFilter)
+    template <typename QueriesType_, typename VisitorType_>
+    void _matchVisit(const QueriesType_& queries_,
+                     const uint32_t& maximum_distance_,
+                     VisitorType_&& visitor_,
+                     const ImageFilter* image_filter_ = nullptr) const {
+      _waitForInsertion();
+      if (queries_.size() == 0 || !_root) {
+        return;
+      }
+      const uint32_t maximum_distance_sketch = _getMaximumDistanceSketch(maximum_distance_);
+
+      // ds for each group of descriptors
+      const Node* leafs[number_of_queries_interleaved];
+      for (size_t index_begin = 0; index_begin < queries_.size();
+           index_begin += number_of_queries_interleaved) {
+        const size_t index_end =
+          std::min(index_begin + number_of_queries_interleaved, queries_.size());
+
+        // ds traverse tree to find the leafs of all descriptors in the group at once
+        _descend(queries_, index_begin, index_end, leafs);
+        for (size_t index_query = index_begin; index_query < index_end; ++index_query) {
+          const Descriptor& descriptor_query = queries_.descriptor(index_query);
+          const Node* leaf                   = leafs[index_query - index_begin];
+          if (leaf->getDistanceLowerBound(descriptor_query) >= maximum_distance_ ||
+              (image_filter_ && !_isEligible(*image_filter_, leaf))) {
+            continue;
+          }
+
+          // ds current best (0 if none)
+          const Matchable* matchable_reference_best = nullptr;
+          uint32_t distance_best                    = maximum_distance_;
+
+          // ds check current descriptors in this leaf
+          const uint64_t sketch_query = Matchable::getSketch(descriptor_query);
+          for (size_t index_reference = 0; index_reference < leaf->getMatchables().size();
+               ++index_reference) {
+            if (!_isWithinSketchDistance(
+                  sketch_query, leaf->getSketches()[index_reference], maximum_distance_sketch)) {
+              continue;
+            }
+            const Matchable* matchable_reference = leaf->getMatchables()[index_reference];
+            const uint32_t distance              = Matchable::distanceBounded(
+              descriptor_query, matchable_reference->descriptor, distance_best);
+            if (distance < distance_best &&
+                (!image_filter_ || _isEligible(*image_filter_, matchable_reference))) {
+              matchable_reference_best = matchable_reference;
+              distance_best            = distance;
+            }
+          }
+
+          // ds if a match was found
+          if (matchable_reference_best) {
+            visitor_(index_query, matchable_reference_best, distance_best);
+          }
+        }
+      }
+    }
+
+    //! @brief retrieves the exact nearest reference per query (see matchExact)
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[out] matches_ output matching results
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @returns number of leafs visited
+    template <typename QueriesType_>
+    size_t _matchExact(const QueriesType_& queries_,
+                       MatchVector& matches_,
+                       const uint32_t& maximum_distance_) const {
+      _waitForInsertion();
+      if (queries_.size() == 0 || !_root) {
+        return 0;
+      }
+      size_t number_of_leafs_visited = 0;
+      const Node* root_search        = _getRootSearch();
+
+      // ds frontier as min-heap on the distance lower bound (storage reused over queries)
+      std::vector<FrontierNode> frontier;
+      for (size_t index_query = 0; index_query < queries_.size(); ++index_query) {
+        const Descriptor& descriptor_query = queries_.descriptor(index_query);
+        const uint64_t sketch_query        = Matchable::getSketch(descriptor_query);
+        const Matchable* matchable_reference_best = nullptr;
+        uint32_t distance_best                    = maximum_distance_;
+        frontier.clear();
+        frontier.push_back(
+          {root_search->getDistanceLowerBound(descriptor_query), 0, root_search});
+        while (!frontier.empty()) {
+          std::pop_heap(frontier.begin(), frontier.end(), std::greater<FrontierNode>());
+          const FrontierNode frontier_node = frontier.back();
+          frontier.pop_back();
+
+          // ds terminate if no unexplored subtree can contain a better reference
+          if (frontier_node.distance_lower_bound >= distance_best) {
+            break;
+          }
+          const Node* node = frontier_node.node;
+          if (node->has_leafs) {
+            // ds the branch against the split bit of the query adds a mismatched bit on the path
+            const bool bit_query = descriptor_query[node->index_split_bit];
+            for (const Node* child : {node->left, node->right}) {
+              const uint32_t number_of_mismatched_split_bits =
+                frontier_node.number_of_mismatched_split_bits +
+                ((child == node->right) != bit_query ? 1 : 0);
+              const uint32_t distance_lower_bound = std::max(
+                number_of_mismatched_split_bits, child->getDistanceLowerBound(descriptor_query));
+              if (distance_lower_bound < distance_best) {
+                frontier.push_back({distance_lower_bound, number_of_mismatched_split_bits, child});
+                std::push_heap(frontier.begin(), frontier.end(), std::greater<FrontierNode>());
+              }
+            }
+          } else {
+            // ds scan the leaf - the sketch stage is always lossless here
+            ++number_of_leafs_visited;
+            for (size_t index_reference = 0; index_reference < node->getMatchables().size();
+                 ++index_reference) {
+              if (!_isWithinSketchDistance(
+                    sketch_query, node->getSketches()[index_reference], distance_best)) {
+                continue;
+              }
+              const Matchable* matchable_reference = node->getMatchables()[index_reference];
+              const uint32_t distance              = Matchable::distanceBounded(
+                descriptor_query, matchable_reference->descriptor, distance_best);
+              if (distance < distance_best) {
+                matchable_reference_best = matchable_reference;
+                distance_best            = distance;
+              }
+            }
+          }
+        }
+
+        // ds if a match was found
+        if (matchable_reference_best) {
+          matches_.push_back(Match(queries_.matchable(index_query),
+                                   matchable_reference_best,
+                                   queries_.object(index_query),
+                                   matchable_reference_best->objects.begin()->second,
+                                   distance_best));
+        }
+      }
+      return number_of_leafs_visited;
+    }
+
+    //! @brief retrieves the unambiguous best reference per query (see matchWithRatio)
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[out] matches_ output matching results
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] ratio_ maximum ratio between best and second best distance
+    template <typename QueriesType_>
+    void _matchWithRatio(const QueriesType_& queries_,
+                         MatchVector& matches_,
+                         const uint32_t& maximum_distance_,
+                         const real_type& ratio_) const {
+      _waitForInsertion();
+      if (queries_.size() == 0 || !_root) {
+        return;
+      }
+
+      // ds the second best is relevant beyond maximum_distance_ (up to the rejection distance)
+      const uint32_t maximum_distance_sketch =
+        _getMaximumDistanceSketch(_getMaximumDistanceSecond(maximum_distance_, ratio_));
+
+      // ds for each group of descriptors
+      const Node* leafs[number_of_queries_interleaved];
+      for (size_t index_begin = 0; index_begin < queries_.size();
+           index_begin += number_of_queries_interleaved) {
+        const size_t index_end =
+          std::min(index_begin + number_of_queries_interleaved, queries_.size());
+
+        // ds traverse tree to find the leafs of all descriptors in the group at once
+        _descend(queries_, index_begin, index_end, leafs);
+        for (size_t index_query = index_begin; index_query < index_end; ++index_query) {
+          const Descriptor& descriptor_query = queries_.descriptor(index_query);
+          const Node* leaf                   = leafs[index_query - index_begin];
+          if (leaf->getDistanceLowerBound(descriptor_query) >= maximum_distance_) {
+            continue;
+          }
+
+          // ds current best (maximum_distance_ if none) and second best (none: maximum value)
+          const Matchable* matchable_reference_best = nullptr;
+          uint32_t distance_best                    = maximum_distance_;
+          uint32_t distance_second                  = std::numeric_limits<uint32_t>::max();
+
+          // ds check current descriptors in this leaf - distances are only evaluated up to the
+          // second best or the distance at which a second best cannot reject the best any more
+          const uint64_t sketch_query = Matchable::getSketch(descriptor_query);
+          for (size_t index_reference = 0; index_reference < leaf->getMatchables().size();
+               ++index_reference) {
+            if (!_isWithinSketchDistance(
+                  sketch_query, leaf->getSketches()[index_reference], maximum_distance_sketch)) {
+              continue;
+            }
+            const Matchable* matchable_reference = leaf->getMatchables()[index_reference];
+            const uint32_t distance              = Matchable::distanceBounded(
+              descriptor_query,
+              matchable_reference->descriptor,
+              std::min(distance_second, _getMaximumDistanceSecond(distance_best, ratio_)));
+            if (distance < distance_best) {
+              if (matchable_reference_best) {
+                distance_second = distance_best;
+              }
+              matchable_reference_best = matchable_reference;
+              distance_best            = distance;
+            } else if (distance < distance_second) {
+              distance_second = distance;
+            }
+          }
+
+          // ds if an unambiguous match was found
+          if (matchable_reference_best && _isPassingRatio(distance_best, distance_second, ratio_)) {
+            matches_.push_back(Match(queries_.matchable(index_query),
+                                     matchable_reference_best,
+                                     queries_.object(index_query),
+                                     matchable_reference_best->objects.begin()->second,
+                                     distance_best));
+          }
+        }
+      }
+    }
+
+    //! @brief ratio test of a best match (see matchWithRatio)
+    //! @param[in] distance_best_ best distance
+    //! @param[in] distance_second_ second best distance (exact below the distance returned by
+    //! _getMaximumDistanceSecond, maximum value if there is no second best reference)
+    //! @param[in] ratio_ maximum ratio between best and second best distance
+    static bool _isPassingRatio(const uint32_t& distance_best_,
+                                const uint32_t& distance_second_,
+                                const real_type& ratio_) {
+      return distance_best_ < ratio_ * distance_second_;
+    }
+
+    //! @brief distance from which on a second best reference cannot reject a best match in the
+    //! ratio test (with a margin against rounding) - second best distances only have to be
+    //! evaluated below it, independent of the maximum matching distance
+    //! @param[in] distance_best_ best distance
+    //! @param[in] ratio_ maximum ratio between best and second best distance
+    //! @returns exclusive bound for the second best distance
+    static uint32_t _getMaximumDistanceSecond(const uint32_t& distance_best_,
+                                              const real_type& ratio_) {
+      const uint32_t distance_maximum = Matchable::descriptor_size_bits + 1;
+      if (ratio_ * distance_maximum <= distance_best_) {
+        return distance_maximum;
+      }
+      return std::min(distance_maximum,
+                      static_cast<uint32_t>(std::ceil(distance_best_ / ratio_)) + 1);
+    }
+
+    //! @brief knn multi-matching with simultaneous adding (see matchAndAdd)
+    //! @param[in] matchables_ query matchables, which will also be added to the tree
+    //! @param[out] matches_ optional output matching results (MatchVectorMap or MatchBuffer) - if
+    //! not set only the insertion is performed (see matchAndAddAsync)
+    //! @param[in] maximum_distance_matching_ the maximum distance allowed for a positive match
+    //! @param[in] train_mode_ splitting strategy for touched leafs
+    //! @param[in,out] track_cache_ optional per-track descent cache (see TrackCache)
+    //! @param[in] identifiers_track_ track identifier per query (required with a track cache)
+    template <typename MatchOutputType_>
+    void _matchAndAdd(const MatchableVector& matchables_,
+                      MatchOutputType_* matches_,
+                      const uint32_t& maximum_distance_matching_,
+                      const SplittingStrategy& train_mode_,
+                      TrackCache* track_cache_           = nullptr,
+                      const uint64_t* identifiers_track_ = nullptr) {
+      if (matchables_.empty()) {
+        return;
+      }
+      const uint64_t identifier_image_query = matchables_.front()->_image_identifier;
+
+      // ds prepare match output for all ids in the tree
+      if (matches_) {
+        _prepareMatches(*matches_, matchables_.size());
+      }
+
+      // ds check if we have to build an initial tree first
+      if (!_root) {
+        _root = new Node(&_configuration, matchables_);
+        assert(_matchables.empty());
+        _matchables.insert(_matchables.end(), matchables_.begin(), matchables_.end());
+        _header.number_of_matchables_uncompressed += matchables_.size();
+        _header.number_of_matchables_compressed = matchables_.size();
+        _added_identifiers_train.insert(identifier_image_query);
+        assert(_added_identifiers_train.size() == 1);
+        _header.number_of_training_entries = 1;
+        _updateLinearStorage();
+        return;
+      }
+
+      // ds prepare node/matchable list to integrate
+      _trainables.resize(matchables_.size());
+      _leafs_to_update.clear();
+
+#ifdef SRRG_MERGE_DESCRIPTORS
+      // ds matches to merge (descriptor distance == SRRG_MERGE_DESCRIPTORS)
+      _merged_matchables.clear();
+      _merged_matchables.reserve(matchables_.size());
+
+      // ds currently we allow merging maximally once per reference matchable
+      _merged_reference_matchables.clear();
+#endif
+
+      // ds for each descriptor
+      uint64_t index_trainable = 0;
+      for (size_t index_query = 0; index_query < matchables_.size(); ++index_query) {
+        Matchable* matchable_query = matchables_[index_query];
+
+        // ds traverse tree to find this descriptor - skipping the cached path of its track
+        Node* node_current  = _root;
+        TrackDescent* track = nullptr;
+        if (track_cache_) {
+          track = &track_cache_->tracks[identifiers_track_[index_query]];
+
+          // ds the cached node is owned by this tree (cache is flushed on structural reset)
+          node_current = const_cast<Node*>(_getTrackStart(*track, matchable_query->descriptor));
+        }
+        while (node_current) {
+          // ds if this node has leaves (is splittable)
+          if (node_current->has_leafs) {
+            if (track) {
+              track->path_mask[node_current->index_split_bit] = 1;
+            }
+
+            // ds check the split bit and go deeper
+            if (matchable_query->descriptor[node_current->index_split_bit]) {
+              node_current = node_current->right;
+            } else {
+              node_current = node_current->left;
+            }
+          } else {
+            // ds obtain best matches in the current leaf via brute-force search - bookkeeping
+            // matches to merge (distance == 0) - skipped if no reference can be within reach
+            _best_matches.clear();
+#ifdef SRRG_MERGE_DESCRIPTORS
+            Matchable* matchable_reference = nullptr;
+            if (!matches_) {
+              matchable_reference =
+                _getMatchableToMerge(matchable_query, node_current, maximum_distance_matching_);
+            } else if (node_current->getDistanceLowerBound(matchable_query->descriptor) <
+                       maximum_distance_matching_) {
+              _matchExhaustive(matchable_query,
+                               node_current,
+                               maximum_distance_matching_,
+                               _best_matches,
+                               matchable_reference);
+            }
+#else
+            if (matches_ && node_current->getDistanceLowerBound(matchable_query->descriptor) <
+                              maximum_distance_matching_) {
+              _matchExhaustive(matchable_query->descriptor,
+                               matchable_query,
+                               matchable_query->objects.begin()->second,
+                               node_current,
+                               maximum_distance_matching_,
+                               _best_matches);
+            }
+#endif
+
+            // ds register all matches in the output structure
+            if (matches_) {
+              _addBestMatches(*matches_, _best_matches);
+            }
+
+#ifdef SRRG_MERGE_DESCRIPTORS
+            // ds if we can merge the query matchable into the reference
+            if (matchable_reference && !_isMergedReference(matchable_reference)) {
+              assert(matchable_query->objects.size() == 1);
+
+              // ds bookkeep matchable for merge
+              _merged_matchables.emplace_back(MatchableMerge(
+                matchable_query, std::move(matchable_query->_object), matchable_reference));
+              _addMergedReference(matchable_reference);
+            } else {
+#endif
+              // ds bookkeep matchable for addition
+              _trainables[index_trainable].node      = node_current;
+              _trainables[index_trainable].matchable = matchable_query;
+              ++index_trainable;
+#ifdef SRRG_MERGE_DESCRIPTORS
+            }
+#endif
+
+            // ds leaf needs to be updated, merged or not
+            ++node_current->_getStorage()->header.number_of_matchables_uncompressed;
+            _updateImageRanges(node_current, identifier_image_query);
+            _leafs_to_update.push_back(node_current);
+            if (track) {
+              _setTrackLeaf(*track, node_current, matchable_query->descriptor);
+            }
+            break;
+          }
+        }
+      }
+      _trainables.resize(index_trainable);
+#ifdef SRRG_MERGE_DESCRIPTORS
+
+      // ds merge matchables
+      for (MatchableMerge& mergable : _merged_matchables) {
+        assert(mergable.reference != mergable.query);
+
+        // ds perform merge
+        mergable.reference->mergeSingle(mergable.query);
+
+        // ds free query (!) recall that the tree takes ownership of the matchables
+        delete mergable.query;
+      }
+      _number_of_merged_matchables_last_training = _merged_matchables.size();
+      _number_of_merged_matchables_total += _merged_matchables.size();
+      _merged_matchables.clear();
+#endif
+
+      // ds integrate new matchables: merge, add and spawn leaves if requested
+      for (const Trainable& trainable : _trainables) {
+        trainable.node->addMatchable(trainable.matchable);
+        _updateBitSummaries(trainable.node, trainable.matchable->descriptor);
+        _matchables.push_back(trainable.matchable);
+      }
+      _spawnLeafs(train_mode_);
+      if (matches_) {
+        _finalizeMatches(*matches_);
+      }
+
+      // ds bookkeeping of new matchables and identifier
+      _header.number_of_matchables_uncompressed += matchables_.size();
+      _header.number_of_matchables_compressed += _trainables.size();
+      _added_identifiers_train.insert(identifier_image_query);
+      ++_header.number_of_training_entries;
+      _updateLinearStorage();
+    }
+
+    //! @brief concurrent insertion (see addConcurrent and matchAndAddConcurrent)
+    //! @param[in] matchables_ matchables of a single image, which will be added to the tree
+    //! @param[in] train_mode_ splitting strategy for overfull leafs
+    //! @param[out] matches_ optional match output (no matching is performed if not set)
+    //! @param[in] maximum_distance_matching_ the maximum distance allowed for a positive match
+    void _addConcurrent(const MatchableVector& matchables_,
+                        const SplittingStrategy& train_mode_,
+                        MatchBuffer* matches_,
+                        const uint32_t& maximum_distance_matching_) {
+      if (matches_) {
+        _prepareMatches(*matches_, matchables_.size());
+      }
+      if (matchables_.empty()) {
+        return;
+      }
+      const uint64_t identifier_image_query = matchables_.front()->_image_identifier;
+
+      // ds check if we have to build an initial tree first (exclusive structure access)
+      LockStructureShared lock_structure(_mutex_structure);
+      if (!_root) {
+        lock_structure.unlock();
+        std::unique_lock<MutexStructure> lock_structure_exclusive(_mutex_structure);
+        if (!_root) {
+          _root = new Node(&_configuration, matchables_, train_mode_);
+          std::lock_guard<std::mutex> lock_bookkeeping(_mutex_bookkeeping);
+          _matchables.insert(_matchables.end(), matchables_.begin(), matchables_.end());
+          _header.number_of_matchables_uncompressed += matchables_.size();
+          _header.number_of_matchables_compressed += matchables_.size();
+          _added_identifiers_train.insert(identifier_image_query);
+          ++_header.number_of_training_entries;
+          _updateLinearStorage();
+          return;
+        }
+        lock_structure_exclusive.unlock();
+        lock_structure.lock();
+      }
+
+      // ds call local bookkeeping (the scratch buffers of the tree are not shared)
+      MatchableVector matchables_inserted;
+      matchables_inserted.reserve(matchables_.size());
+      std::vector<Node*> leafs_to_split;
+      BestMatchVector best_matches;
+#ifdef SRRG_MERGE_DESCRIPTORS
+      MatchableMergeVector merged_matchables;
+      std::vector<const Matchable*> merged_reference_matchables;
+#endif
+
+      // ds for each descriptor - the structure cannot change while we hold the shared lock
+      for (Matchable* matchable_query : matchables_) {
+        Node* leaf = _root;
+        while (leaf->has_leafs) {
+          if (matchable_query->descriptor[leaf->index_split_bit]) {
+            leaf = leaf->right;
+          } else {
+            leaf = leaf->left;
+          }
+        }
+
+        // ds the leaf content is guarded by its lock (shared with other leafs of the stripe)
+        std::unique_lock<std::mutex> lock_leaf(_getMutexLeaf(leaf));
+        const uint32_t distance_lower_bound =
+          leaf->getDistanceLowerBound(matchable_query->descriptor);
+        if (matches_ && distance_lower_bound < maximum_distance_matching_) {
+          best_matches.clear();
+          _matchExhaustive(matchable_query->descriptor,
+                           matchable_query,
+                           matchable_query->objects.begin()->second,
+                           leaf,
+                           maximum_distance_matching_,
+                           best_matches);
+          _addBestMatches(*matches_, best_matches);
+        }
+        bool insertion_required = true;
+#ifdef SRRG_MERGE_DESCRIPTORS
+
+        // ds if we can absorb this matchable instead of having to insert it
+        if (distance_lower_bound <= _configuration.maximum_distance_for_merge) {
+          for (Matchable* matchable_reference : leaf->getMatchables()) {
+            if (matchable_reference->distanceBounded(
+                  matchable_query, _configuration.maximum_distance_for_merge) <=
+                  _configuration.maximum_distance_for_merge &&
+                !std::binary_search(merged_reference_matchables.begin(),
+                                    merged_reference_matchables.end(),
+                                    matchable_reference)) {
+              assert(matchable_query->objects.size() == 1);
+              merged_matchables.emplace_back(MatchableMerge(
+                matchable_query, std::move(matchable_query->_object), matchable_reference));
+              merged_reference_matchables.insert(
+                std::lower_bound(merged_reference_matchables.begin(),
+                                 merged_reference_matchables.end(),
+                                 matchable_reference),
+                matchable_reference);
+
+              // ds perform merge and free query (the tree takes ownership of the matchables)
+              matchable_reference->mergeSingle(matchable_query);
+              delete matchable_query;
+              insertion_required = false;
+              break;
+            }
+          }
+        }
+#endif
+        if (insertion_required) {
+          leaf->addMatchable(matchable_query);
+          leaf->_getStorage()->header.number_of_matchables_compressed =
+            leaf->getMatchables().size();
+          leaf->updateBitSummaries(matchable_query->descriptor);
+          matchables_inserted.push_back(matchable_query);
+        }
+        leaf->updateImageRange(identifier_image_query);
+
+        // ds bookkeep leafs that might be split
+        if (++leaf->_getStorage()->header.number_of_matchables_uncompressed >=
+              _configuration.maximum_leaf_size &&
+            leaf->_getStorage()->header.depth < _configuration.maximum_depth) {
+          leafs_to_split.push_back(leaf);
+        }
+        lock_leaf.unlock();
+
+        // ds update the summaries of all parents (each under its own lock)
+        for (Node* node = leaf->parent; node && node->summary; node = node->parent) {
+          std::lock_guard<std::mutex> lock_node(_getMutexLeaf(node));
+          if (insertion_required) {
+            node->updateBitSummaries(matchable_query->descriptor);
+          }
+          node->updateImageRange(identifier_image_query);
+        }
+      }
+      lock_structure.unlock();
+      if (matches_) {
+        _finalizeMatches(*matches_);
+      }
+
+      // ds bookkeeping of new matchables and identifier
+      {
+        std::lock_guard<std::mutex> lock_bookkeeping(_mutex_bookkeeping);
+        _matchables.insert(
+          _matchables.end(), matchables_inserted.begin(), matchables_inserted.end());
+        _header.number_of_matchables_uncompressed += matchables_.size();
+        _header.number_of_matchables_compressed += matchables_inserted.size();
+        _added_identifiers_train.insert(identifier_image_query);
+        ++_header.number_of_training_entries;
+#ifdef SRRG_MERGE_DESCRIPTORS
+        _number_of_merged_matchables_last_training = merged_matchables.size();
+        _number_of_merged_matchables_total += merged_matchables.size();
+        _merged_matchables.swap(merged_matchables);
+#endif
+      }
+
+      // ds split overfull leafs with exclusive structure access (within the split budget) - a
+      // leaf might have been split by another caller in the meantime
+      if (!leafs_to_split.empty() && train_mode_ != SplittingStrategy::DoNothing) {
+        std::sort(leafs_to_split.begin(), leafs_to_split.end());
+        leafs_to_split.erase(std::unique(leafs_to_split.begin(), leafs_to_split.end()),
+                             leafs_to_split.end());
+        std::unique_lock<MutexStructure> lock_structure_exclusive(_mutex_structure);
+        _addPendingLeafs(leafs_to_split);
+        _splitPendingLeafs(train_mode_, _configuration.maximum_number_of_splits_per_call);
+      }
+
+      // ds synchronize the linear search storage with exclusive access
+      if (_configuration.maximum_number_of_matchables_linear_search > 0) {
+        std::unique_lock<MutexStructure> lock_structure_exclusive(_mutex_structure);
+        std::lock_guard<std::mutex> lock_bookkeeping(_mutex_bookkeeping);
+        _updateLinearStorage();
+      }
+    }
+
+    //! @brief lock guarding the content of a leaf (striped over a fixed number of locks)
+    //! @param[in] leaf_ leaf to lock
+    //! @returns the mutex of the leaf stripe
+    std::mutex& _getMutexLeaf(const Node* leaf_) const {
+      return _mutexes_leafs[(reinterpret_cast<std::uintptr_t>(leaf_) / sizeof(Node)) %
+                            number_of_leaf_locks];
+    }
+
+    //! @brief knn multi-matching function (see match with MatchVectorMap or MatchBuffer)
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[out] matches_ output matching results (MatchVectorMap or MatchBuffer)
+    //! @param[in] maximum_distance_matching_ the maximum distance allowed for a positive match
+    //! @param[in] image_filter_ optional eligible reference images (see ImageFilter)
+    template <typename QueriesType_, typename MatchOutputType_>
+    void _matchPerImage(const QueriesType_& queries_,
+                        MatchOutputType_& matches_,
+                        const uint32_t& maximum_distance_matching_,
+                        const ImageFilter* image_filter_ = nullptr) const {
+      _waitForInsertion();
+      // ds prepare match output for all ids in the tree
+      _prepareMatches(matches_, queries_.size());
+      _matchBestPerImage(queries_,
+                         maximum_distance_matching_,
+                         [&matches_](const BestMatchVector& best_matches_) {
+                           _addBestMatches(matches_, best_matches_);
+                         },
+                         image_filter_);
+      _finalizeMatches(matches_);
+    }
+
+    //! @brief knn multi-matching with a ratio test per reference image (see matchWithRatio)
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[out] matches_ output matching results (MatchVectorMap or MatchBuffer)
+    //! @param[in] maximum_distance_matching_ the maximum distance allowed for a positive match
+    //! @param[in] ratio_ maximum ratio between best and second best distance in an image
+    template <typename QueriesType_, typename MatchOutputType_>
+    void _matchPerImageWithRatio(const QueriesType_& queries_,
+                                 MatchOutputType_& matches_,
+                                 const uint32_t& maximum_distance_matching_,
+                                 const real_type& ratio_) const {
+      _waitForInsertion();
+      _prepareMatches(matches_, queries_.size());
+      if (queries_.size() == 0 || !_root) {
+        return;
+      }
+
+      // ds the second best is relevant beyond the maximum matching distance (see matchWithRatio)
+      const uint32_t maximum_distance_second =
+        _getMaximumDistanceSecond(maximum_distance_matching_, ratio_);
+      const uint32_t maximum_distance_sketch = _getMaximumDistanceSketch(maximum_distance_second);
+
+      // ds best match candidates per query (storage reused over queries)
+      RatioCandidateVector candidates;
+
+      // ds for each group of descriptors
+      const Node* leafs[number_of_queries_interleaved];
+      for (size_t index_begin = 0; index_begin < queries_.size();
+           index_begin += number_of_queries_interleaved) {
+        const size_t index_end =
+          std::min(index_begin + number_of_queries_interleaved, queries_.size());
+
+        // ds traverse tree to find the leafs of all descriptors in the group at once
+        _descend(queries_, index_begin, index_end, leafs);
+        for (size_t index_query = index_begin; index_query < index_end; ++index_query) {
+          const Descriptor& descriptor_query = queries_.descriptor(index_query);
+          const Node* leaf                   = leafs[index_query - index_begin];
+          if (leaf->getDistanceLowerBound(descriptor_query) >= maximum_distance_matching_) {
+            continue;
+          }
+
+          // ds track best and second best distance for each reference image in this leaf - images
+          // might only have a second best (beyond the maximum matching distance)
+          candidates.clear();
+          const uint64_t sketch_query = Matchable::getSketch(descriptor_query);
+          for (size_t index_reference = 0; index_reference < leaf->getMatchables().size();
+               ++index_reference) {
+            if (!_isWithinSketchDistance(
+                  sketch_query, leaf->getSketches()[index_reference], maximum_distance_sketch)) {
+              continue;
+            }
+            const Matchable* matchable_reference = leaf->getMatchables()[index_reference];
+            const uint32_t distance              = Matchable::distanceBounded(
+              descriptor_query, matchable_reference->descriptor, maximum_distance_second);
+            if (distance >= maximum_distance_second) {
+              continue;
+            }
+#ifdef SRRG_MERGE_DESCRIPTORS
+            for (const typename ObjectMap::value_type& object : matchable_reference->objects) {
+              const uint64_t& identifier_reference = object.first;
+              const ObjectType& object_reference   = object.second;
+#else
+            const uint64_t& identifier_reference = matchable_reference->_image_identifier;
+            const ObjectType& object_reference =
+              matchable_reference->objects.at(identifier_reference);
+#endif
+              RatioCandidate* candidate = nullptr;
+              for (RatioCandidate& candidate_image : candidates) {
+                if (candidate_image.identifier_reference == identifier_reference) {
+                  candidate = &candidate_image;
+                  break;
+                }
+              }
+              if (!candidate) {
+                Match match_none;
+                match_none.distance = maximum_distance_matching_;
+                candidates.push_back(
+                  {identifier_reference, match_none, std::numeric_limits<uint32_t>::max()});
+                candidate = &candidates.back();
+              }
+              if (distance < candidate->match.distance) {
+                if (candidate->match.matchable_reference) {
+                  candidate->distance_second = candidate->match.distance;
+                }
+                candidate->match = Match(queries_.matchable(index_query),
+                                         matchable_reference,
+                                         queries_.object(index_query),
+                                         object_reference,
+                                         distance);
+              } else if (distance < candidate->distance_second) {
+                candidate->distance_second = distance;
+              }
+#ifdef SRRG_MERGE_DESCRIPTORS
+            }
+#endif
+          }
+
+          // ds register all unambiguous matches in the output structure
+          for (const RatioCandidate& candidate : candidates) {
+            if (candidate.match.matchable_reference &&
+                _isPassingRatio(candidate.match.distance, candidate.distance_second, ratio_)) {
+              _addMatch(matches_, candidate.identifier_reference, candidate.match);
+            }
+          }
+        }
+      }
+      _finalizeMatches(matches_);
+    }
+
+    //! @brief visits the best match per query and reference image (see matchPerImage)
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[in] maximum_distance_matching_ the maximum distance allowed for a positive match
+    //! @param[in] visitor_ callable (identifier_reference, match)
+    //! @param[in] image_filter_ optional eligible reference images (see ImageFilter)
+    template <typename QueriesType_, typename VisitorType_>
+    void _matchPerImageVisit(const QueriesType_& queries_,
+                             const uint32_t& maximum_distance_matching_,
+                             VisitorType_&& visitor_,
+                             const ImageFilter* image_filter_ = nullptr) const {
+      _matchBestPerImage(queries_,
+                         maximum_distance_matching_,
+                         [&visitor_](const BestMatchVector& best_matches_) {
+                           for (const std::pair<uint64_t, Match>& best_match :
+                                best_matches_.matches) {
+                             visitor_(best_match.first, best_match.second);
+                           }
+                         },
+                         image_filter_);
+    }
+
+    //! @brief visits the best match candidates of every query (see _matchPerImageVisit)
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[in] maximum_distance_matching_ the maximum distance allowed for a positive match
+    //! @param[in] visitor_ callable (best_matches) - candidates of a query including their ties
+    //! @param[in] image_filter_ optional eligible reference images (see ImageFilter)
+    template <typename QueriesType_, typename VisitorType_>
+    void _matchBestPerImage(const QueriesType_& queries_,
+                            const uint32_t& maximum_distance_matching_,
+                            VisitorType_&& visitor_,
+                            const ImageFilter* image_filter_ = nullptr) const {
+      _waitForInsertion();
+      if (queries_.size() == 0 || !_root) {
+        return;
+      }
+
+      // ds best match candidates per query (storage reused over queries)
+      BestMatchVector best_matches;
+
+      // ds for each group of descriptors
+      const Node* leafs[number_of_queries_interleaved];
+      for (size_t index_begin = 0; index_begin < queries_.size();
+           index_begin += number_of_queries_interleaved) {
+        const size_t index_end =
+          std::min(index_begin + number_of_queries_interleaved, queries_.size());
+
+        // ds traverse tree to find the leafs of all descriptors in the group at once
+        _descend(queries_, index_begin, index_end, leafs);
+        for (size_t index_query = index_begin; index_query < index_end; ++index_query) {
+          const Node* leaf = leafs[index_query - index_begin];
+          if (leaf->getDistanceLowerBound(queries_.descriptor(index_query)) >=
+                maximum_distance_matching_ ||
+              (image_filter_ && !_isEligible(*image_filter_, leaf))) {
+            continue;
+          }
+
+          // ds obtain best matches in the current leaf via brute-force search
+          best_matches.clear();
+          _matchExhaustive(queries_.descriptor(index_query),
+                           queries_.matchable(index_query),
+                           queries_.object(index_query),
+                           leaf,
+                           maximum_distance_matching_,
+                           best_matches,
+                           image_filter_);
+
+          // ds report all matches
+          visitor_(best_matches);
+        }
+      }
+    }
+
+#ifdef SRRG_MERGE_DESCRIPTORS
+    //! @brief retrieves best matches (BF search) for provided matchables for all image indices
+    //! @param[in] descriptor_query_
+    //! @param[in] matchable_query_ query matchable (nullptr for descriptor queries)
+    //! @param[in] object_query_
+    //! @param[in] leaf_ leaf with the reference matchables
+    //! @param[in] maximum_distance_matching_
+    //! @param[in,out] best_matches_ best match search storage: image id, match candidate
+    //! @param[in] image_filter_ optional eligible reference images (see ImageFilter)
+    void _matchExhaustive(const Descriptor& descriptor_query_,
+                          const Matchable* matchable_query_,
+                          const ObjectType& object_query_,
+                          const Node* leaf_,
+                          const uint32_t& maximum_distance_matching_,
+                          BestMatchVector& best_matches_,
+                          const ImageFilter* image_filter_ = nullptr) const {
+      const uint32_t maximum_distance_sketch =
+        _getMaximumDistanceSketch(maximum_distance_matching_);
+      const uint64_t sketch_query = Matchable::getSketch(descriptor_query_);
+
+      // ds check current descriptors in this node - full comparison only past the sketch stage
+      for (size_t index_reference = 0; index_reference < leaf_->getMatchables().size();
+           ++index_reference) {
+        if (!_isWithinSketchDistance(
+              sketch_query, leaf_->getSketches()[index_reference], maximum_distance_sketch)) {
+          continue;
+        }
+        const Matchable* matchable_reference = leaf_->getMatchables()[index_reference];
+
+        // ds compute the descriptor distance
+        const uint32_t distance = Matchable::distanceBounded(
+          descriptor_query_, matchable_reference->descriptor, maximum_distance_matching_);
+
+        // ds if matching distance is within the threshold
+        if (distance < maximum_distance_matching_) {
+          // ds for every (eligible) reference in this matchable
+          for (const typename ObjectMap::value_type& object : matchable_reference->objects) {
+            const uint64_t& identifer_tree_reference = object.first;
+            if (image_filter_ && !image_filter_->isEligible(identifer_tree_reference)) {
+              continue;
+            }
+
+            // ds update match if current is better than the current best - add it if there is none
+            _updateBestMatch(best_matches_,
+                             identifer_tree_reference,
+                             matchable_query_,
+                             object_query_,
+                             matchable_reference,
+                             object.second,
+                             distance);
+          }
+        }
+      }
+    }
+
+    //! @brief merge candidate search of _matchExhaustive without matching (see matchAndAddAsync)
+    //! @param[in] matchable_query_
+    //! @param[in] leaf_ leaf with the reference matchables
+    //! @param[in] maximum_distance_matching_ matching threshold of the query (sketch prefilter)
+    //! @returns the reference matchable _matchExhaustive would merge into (nullptr if none)
+    Matchable* _getMatchableToMerge(const Matchable* matchable_query_,
+                                    const Node* leaf_,
+                                    const uint32_t& maximum_distance_matching_) const {
+      Matchable* matchable_reference_for_merge = nullptr;
+      if (leaf_->getDistanceLowerBound(matchable_query_->descriptor) >
+          _configuration.maximum_distance_for_merge) {
+        return matchable_reference_for_merge;
+      }
+      const uint32_t maximum_distance_sketch =
+        _getMaximumDistanceSketch(maximum_distance_matching_);
+      const uint64_t sketch_query = Matchable::getSketch(matchable_query_->descriptor);
+
+      // ds the last reference within merge distance is taken, as in _matchExhaustive
+      for (size_t index_reference = 0; index_reference < leaf_->getMatchables().size();
+           ++index_reference) {
+        if (!_isWithinSketchDistance(
+              sketch_query, leaf_->getSketches()[index_reference], maximum_distance_sketch)) {
+          continue;
+        }
+        Matchable* matchable_reference = leaf_->getMatchables()[index_reference];
+        if (matchable_query_->distanceBounded(matchable_reference,
+                                              _configuration.maximum_distance_for_merge) <=
+            _configuration.maximum_distance_for_merge) {
+          matchable_reference_for_merge = matchable_reference;
+        }
+      }
+      return matchable_reference_for_merge;
+    }
+
+    //! @brief retrieves best matches (BF search) for provided matchables for all image indices
+    //! @param[in] matchable_query_
+    //! @param[in] leaf_ leaf with the reference matchables
+    //! @param[in] maximum_distance_matching_
+    //! @param[in,out] best_matches_ best match search storage: image id, match candidate
+    //! @param[in,out] matchable_reference_for_merge_ reference matchable with distance == 0
+    //! (matchable merge candidate)
+    void _matchExhaustive(const Matchable* matchable_query_,
+                          const Node* leaf_,
+                          const uint32_t& maximum_distance_matching_,
+                          BestMatchVector& best_matches_,
+                          Matchable*& matchable_reference_for_merge_) const {
+      ObjectType object_query =
+        std::move(matchable_query_->objects.at(matchable_query_->_image_identifier));
+      const uint32_t maximum_distance_sketch =
+        _getMaximumDistanceSketch(maximum_distance_matching_);
+      const uint64_t sketch_query = Matchable::getSketch(matchable_query_->descriptor);
+
+      // ds check current descriptors in this node - full comparison only past the sketch stage
+      for (size_t index_reference = 0; index_reference < leaf_->getMatchables().size();
+           ++index_reference) {
+        if (!_isWithinSketchDistance(
+              sketch_query, leaf_->getSketches()[index_reference], maximum_distance_sketch)) {
+          continue;
+        }
+        const Matchable* matchable_reference = leaf_->getMatchables()[index_reference];
+        // ds compute the descriptor distance
+        const uint32_t distance =
+          matchable_query_->distanceBounded(matchable_reference, maximum_distance_matching_);
+
+        // ds if matching distance is within the threshold
+        if (distance < maximum_distance_matching_) {
+          // ds for every reference in this matchable
+          for (const typename ObjectMap::value_type& object : matchable_reference->objects) {
+            const uint64_t& identifer_tree_reference = object.first;
+
+            // ds update match if current is better than the current best - add it if there is none
+            _updateBestMatch(best_matches_,
+                             identifer_tree_reference,
+                             matchable_query_,
+                             object_query,
+                             matchable_reference,
+                             object.second,
+                             distance);
+          }
+
+          // ds if the matchable descriptors are identical - we can merge - note that
+          // maximum_distance_for_merge must always be smaller than maximum_distance_matching_
+          assert(_configuration.maximum_distance_for_merge < maximum_distance_matching_);
+          if (distance <= _configuration.maximum_distance_for_merge) {
+            // ds behold the power of C++ (we want to keep the MatchableVector elements const)
+            matchable_reference_for_merge_ = const_cast<Matchable*>(matchable_reference);
+          }
+        }
+      }
+    }
+#else
+    //! @brief retrieves best matches (BF search) for provided matchables for all image indices
+    //! @param[in] descriptor_query_
+    //! @param[in] matchable_query_ query matchable (nullptr for descriptor queries)
+    //! @param[in] object_query_
+    //! @param[in] leaf_ leaf with the reference matchables
+    //! @param[in] maximum_distance_matching_
+    //! @param[in,out] best_matches_ best match search storage: image id, match candidate
+    //! @param[in] image_filter_ optional eligible reference images (see ImageFilter)
+    void _matchExhaustive(const Descriptor& descriptor_query_,
+                          const Matchable* matchable_query_,
+                          const ObjectType& object_query_,
+                          const Node* leaf_,
+                          const uint32_t& maximum_distance_matching_,
+                          BestMatchVector& best_matches_,
+                          const ImageFilter* image_filter_ = nullptr) const {
+      const uint32_t maximum_distance_sketch =
+        _getMaximumDistanceSketch(maximum_distance_matching_);
+      const uint64_t sketch_query = Matchable::getSketch(descriptor_query_);
+
+      // ds check current descriptors in this node - full comparison only past the sketch stage
+      for (size_t index_reference = 0; index_reference < leaf_->getMatchables().size();
+           ++index_reference) {
+        if (!_isWithinSketchDistance(
+              sketch_query, leaf_->getSketches()[index_reference], maximum_distance_sketch)) {
+          continue;
+        }
+        const Matchable* matchable_reference = leaf_->getMatchables()[index_reference];
+
+        // ds compute the descriptor distance
+        const uint32_t distance = Matchable::distanceBounded(
+          descriptor_query_, matchable_reference->descriptor, maximum_distance_matching_);
+
+        // ds if matching distance is within the threshold (and the reference image is eligible)
+        if (distance < maximum_distance_matching_ &&
+            (!image_filter_ || image_filter_->isEligible(matchable_reference->_image_identifier))) {
+          const uint64_t& identifer_tree_reference = matchable_reference->_image_identifier;
+          assert(matchable_reference->objects.find(identifer_tree_reference) !=
+                 matchable_reference->objects.end());
+          ObjectType object_reference =
+            std::move(matchable_reference->objects.at(identifer_tree_reference));
+
+          // ds update match if current is better than the current best - add it if there is none
+          _updateBestMatch(best_matches_,
+                           identifer_tree_reference,
+                           matchable_query_,
+                           object_query_,
+                           matchable_reference,
+                           object_reference,
+                           distance);
+        }
+      }
+    }
+#endif
+
+    //! @brief updates the best match candidate of a reference image with a reference within the
+    //! matching distance: a closer reference replaces the candidate, an equally close one is tied
+    //! @param[in,out] best_matches_ best match search storage: image id, match candidate, ties
+    //! @param[in] identifier_reference_ reference image identifier
+    //! @param[in] matchable_query_
+    //! @param[in] object_query_
+    //! @param[in] matchable_reference_
+    //! @param[in] object_reference_
+    //! @param[in] distance_ matching distance of the reference
+    static void _updateBestMatch(BestMatchVector& best_matches_,
+                                 const uint64_t& identifier_reference_,
+                                 const Matchable* matchable_query_,
+                                 const ObjectType& object_query_,
+                                 const Matchable* matchable_reference_,
+                                 const ObjectType& object_reference_,
+                                 const uint32_t& distance_) {
+      for (size_t index_best_match = 0; index_best_match < best_matches_.matches.size();
+           ++index_best_match) {
+        if (best_matches_.matches[index_best_match].first != identifier_reference_) {
+          continue;
+        }
+        Match& best_match_so_far = best_matches_.matches[index_best_match].second;
+        if (distance_ < best_match_so_far.distance) {
+          // ds replace the best with this match on the spot - we don't have to update the query
+          // information, the ties of the replaced candidate are outdated
+          best_match_so_far.matchable_reference  = matchable_reference_;
+          best_match_so_far.object_reference     = object_reference_;
+          best_match_so_far.distance             = distance_;
+          best_match_so_far.number_of_references = 1;
+        }
+
+        // ds if the match is equal to the last (multiple candidates)
+        else if (distance_ == best_match_so_far.distance) {
+          ++best_match_so_far.number_of_references;
+          best_matches_.ties.push_back(
+            {index_best_match, distance_, {matchable_reference_, object_reference_}});
+        }
+        return;
+      }
+
+      // ds add a new match
+      best_matches_.matches.emplace_back(
+        std::make_pair(identifier_reference_,
+                       Match(matchable_query_,
+                             matchable_reference_,
+                             object_query_,
+                             object_reference_,
+                             distance_)));
+    }
+
+    //! @brief guards a query against a pending background insertion (see matchAndAddAsync): waits
+    //! for it if configured, otherwise it must have been synchronized by the caller
+    void _waitForInsertion() const {
+      if (!_insertion.valid()) {
+        return;
+      }
+      if (_configuration.wait_for_insertion) {
+        _insertion.wait();
+      } else {
+        assert(_insertion.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+      }
+    }
+
+    //! @brief prepares the match vector map for all ids in the tree - existing entries (and their
+    //! capacities) are reused, entries of unknown image ids are removed
+    //! @param[in,out] matches_ match vector map to prepare
+    //! @param[in] number_of_queries_ number of queries (match capacity per image)
+    void _prepareMatches(MatchVectorMap& matches_, const size_t& number_of_queries_) const {
+      for (const uint64_t identifier_tree : _added_identifiers_train) {
+        MatchVector& matches = matches_[identifier_tree];
+        matches.clear();
+
+        // ds preallocate space to speed up match addition
+        matches.reserve(number_of_queries_);
+      }
+      if (matches_.size() != _added_identifiers_train.size()) {
+        for (typename MatchVectorMap::iterator it = matches_.begin(); it != matches_.end();) {
+          if (_added_identifiers_train.count(it->first) == 0) {
+            it = matches_.erase(it);
+          } else {
+            ++it;
+          }
+        }
+      }
+    }
+
+    //! @brief prepares the sparse match output - storage (and its capacity) is reused
+    //! @param[in,out] matches_ match buffer to prepare
+    void _prepareMatches(MatchBuffer& matches_, const size_t& /*number_of_queries_*/) const {
+      matches_.identifiers.clear();
+      matches_.offsets.assign(1, 0);
+      matches_.matches.clear();
+      matches_.references.clear();
+      matches_.identifiers_unsorted.clear();
+      matches_.matches_unsorted.clear();
+    }
+
+    //! @brief registers a match for a reference image in the match output
+    static void _addMatch(MatchVectorMap& matches_,
+                          const uint64_t& identifier_reference_,
+                          const Match& match_) {
+      matches_.at(identifier_reference_).push_back(match_);
+    }
+    static void _addMatch(MatchBuffer& matches_,
+                          const uint64_t& identifier_reference_,
+                          const Match& match_) {
+      matches_.identifiers_unsorted.push_back(identifier_reference_);
+      matches_.matches_unsorted.push_back(match_);
+    }
+
+    //! @brief registers the best match candidates of a query in the match output - tied references
+    //! are only kept by the side table of a MatchBuffer (MatchVectorMap: counted)
+    static void _addBestMatches(MatchVectorMap& matches_, const BestMatchVector& best_matches_) {
+      for (const std::pair<uint64_t, Match>& best_match : best_matches_.matches) {
+        _addMatch(matches_, best_match.first, best_match.second);
+      }
+    }
+    static void _addBestMatches(MatchBuffer& matches_, const BestMatchVector& best_matches_) {
+      for (size_t index_best_match = 0; index_best_match < best_matches_.matches.size();
+           ++index_best_match) {
+        Match match            = best_matches_.matches[index_best_match].second;
+        match.index_references = matches_.references.size();
+        for (const BestMatchTie& tie : best_matches_.ties) {
+          if (tie.index_best_match == index_best_match && tie.distance == match.distance) {
+            matches_.references.push_back(tie.reference);
+          }
+        }
+        assert(matches_.references.size() - match.index_references ==
+               match.number_of_references - 1);
+        _addMatch(matches_, best_matches_.matches[index_best_match].first, match);
+      }
+    }
+
+    //! @brief completes the match output after all matches have been added
+    static void _finalizeMatches(MatchVectorMap& /*matches_*/) {
+    }
+
+    //! @brief buckets the staged matches by image (stable counting sort, query order is kept)
+    //! @param[in,out] matches_ match buffer to finalize
+    static void _finalizeMatches(MatchBuffer& matches_) {
+      if (matches_.matches_unsorted.empty()) {
+        return;
+      }
+
+      // ds matched image identifiers (sorted insertion, few images compared to matches)
+      std::vector<uint64_t>& identifiers = matches_.identifiers;
+      for (const uint64_t& identifier_reference : matches_.identifiers_unsorted) {
+        std::vector<uint64_t>::iterator it =
+          std::lower_bound(identifiers.begin(), identifiers.end(), identifier_reference);
+        if (it == identifiers.end() || *it != identifier_reference) {
+          identifiers.insert(it, identifier_reference);
+        }
+      }
+
+      // ds count matches per image and compute bucket begins
+      std::vector<size_t>& offsets = matches_.offsets;
+      offsets.clear();
+      _reserve(offsets, identifiers.size() + 1);
+      offsets.resize(identifiers.size() + 1, 0);
+      for (const uint64_t& identifier_reference : matches_.identifiers_unsorted) {
+        ++offsets[_getIndexImage(matches_.identifiers, identifier_reference) + 1];
+      }
+      for (size_t index_image = 1; index_image < offsets.size(); ++index_image) {
+        offsets[index_image] += offsets[index_image - 1];
+      }
+
+      // ds scatter matches into their buckets (advances every bucket begin to its end)
+      _reserve(matches_.matches, matches_.matches_unsorted.size());
+      matches_.matches.resize(matches_.matches_unsorted.size());
+      for (size_t index_match = 0; index_match < matches_.matches_unsorted.size();
+           ++index_match) {
+        const size_t index_image =
+          _getIndexImage(matches_.identifiers, matches_.identifiers_unsorted[index_match]);
+        matches_.matches[offsets[index_image]++] = matches_.matches_unsorted[index_match];
+      }
+
+      // ds restore bucket begins
+      for (size_t index_image = offsets.size() - 1; index_image > 0; --index_image) {
+        offsets[index_image] = offsets[index_image - 1];
+      }
+      offsets[0] = 0;
+    }
+
+    //! @brief grows reused storage geometrically (amortized constant number of allocations)
+    //! @param[in,out] vector_ storage to grow
+    //! @param[in] size_ required capacity
+    template <typename ElementType_>
+    static void _reserve(std::vector<ElementType_>& vector_, const size_t& size_) {
+      if (vector_.capacity() < size_) {
+        vector_.reserve(std::max(size_, 2 * vector_.capacity()));
+      }
+    }
+
+    //! @brief bucket index of an image identifier in the sorted matched identifiers
+    static size_t _getIndexImage(const std::vector<uint64_t>& identifiers_,
+                                 const uint64_t& identifier_reference_) {
+      return std::lower_bound(identifiers_.begin(), identifiers_.end(), identifier_reference_) -
+             identifiers_.begin();
+    }
+
+    //! @brief descends a group of queries in lockstep through the tree - instead of waiting for
+    //! each dependent node load of a single query, the next node of every query in the group is
+    //! prefetched and the memory latencies of the group overlap
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[in] index_begin_ first query index of the group
+    //! @param[in] index_end_ query index after the last of the group (at most
+    //! number_of_queries_interleaved queries)
+    //! @param[out] leafs_ destination leaf per query of the group (starting at index_begin_)
+    template <typename QueriesType_>
+    void _descend(const QueriesType_& queries_,
+                  const size_t& index_begin_,
+                  const size_t& index_end_,
+                  const Node** leafs_) const {
+      assert(_root);
+      assert(index_end_ - index_begin_ <= number_of_queries_interleaved);
+      const Node* root_search = _getRootSearch();
+
+      // ds queries that have not reached a leaf yet (compacted after every step)
+      uint32_t indices_descending[number_of_queries_interleaved];
+      TrackDescent* tracks[number_of_queries_interleaved] = {nullptr};
+      size_t number_of_queries_descending = 0;
+      for (size_t index_query = index_begin_; index_query < index_end_; ++index_query) {
+        const uint32_t index_group = index_query - index_begin_;
+        leafs_[index_group]        = root_search;
+
+        // ds tracked queries start at the end of their cached path (if still valid) - the tree is
+        // not descended by the linear search, which leaves the cache untouched
+        if (QueriesType_::tracked && root_search == _root) {
+          tracks[index_group] = queries_.track(index_query);
+          leafs_[index_group] =
+            _getTrackStart(*tracks[index_group], queries_.descriptor(index_query));
+        }
+        indices_descending[number_of_queries_descending++] = index_group;
+      }
+
+      // ds advance all descending queries by one level per iteration
+      while (number_of_queries_descending > 0) {
+        size_t number_of_queries_still_descending = 0;
+        for (size_t i = 0; i < number_of_queries_descending; ++i) {
+          const uint32_t index_group = indices_descending[i];
+          const Node* node_current   = leafs_[index_group];
+          if (node_current->has_leafs) {
+            if (tracks[index_group]) {
+              tracks[index_group]->path_mask[node_current->index_split_bit] = 1;
+            }
+
+            // ds check the split bit and go deeper - requesting the next node ahead of time
+            if (queries_.descriptor(index_begin_ + index_group)[node_current->index_split_bit]) {
+              node_current = node_current->right;
+            } else {
+              node_current = node_current->left;
+            }
+            SRRG_HBST_PREFETCH(node_current);
+            SRRG_HBST_PREFETCH(&node_current->has_leafs);
+            leafs_[index_group]                                      = node_current;
+            indices_descending[number_of_queries_still_descending++] = index_group;
+          } else {
+            if (tracks[index_group]) {
+              _setTrackLeaf(*tracks[index_group],
+                            node_current,
+                            queries_.descriptor(index_begin_ + index_group));
+            }
+
+            // ds arrived in a leaf - request its storage (summaries and reference vectors)
+            SRRG_HBST_PREFETCH(node_current->summary);
+          }
+        }
+        number_of_queries_descending = number_of_queries_still_descending;
+      }
+
+      // ds request the contiguous sketch and reference blocks of all leafs for the upcoming
+      // scans - their storage has been requested on arrival, interleaved with the other queries
+      for (size_t index_group = 0; index_group < index_end_ - index_begin_; ++index_group) {
+        SRRG_HBST_PREFETCH(leafs_[index_group]->getSketches().data());
+        SRRG_HBST_PREFETCH(leafs_[index_group]->getMatchables().data());
+      }
+    }
+
+    //! @brief range search (see matchRadius)
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[out] matches_ output matching results, bucketed by query
+    //! @param[in] radius_ maximum distance of a returned reference (inclusive)
+    //! @param[in] maximum_number_of_matches_per_query_ only the nearest references are kept
+    //! @param[in] number_of_probes_ number of additional leafs scanned per query
+    template <typename QueriesType_>
+    void _matchRadius(const QueriesType_& queries_,
+                      RadiusMatchBuffer& matches_,
+                      const uint32_t& radius_,
+                      const size_t& maximum_number_of_matches_per_query_,
+                      const size_t& number_of_probes_) const {
+      _waitForInsertion();
+      matches_.offsets.assign(1, 0);
+      matches_.matches.clear();
+      if (!_root) {
+        matches_.offsets.resize(queries_.size() + 1, 0);
+        return;
+      }
+      const uint32_t maximum_distance        = radius_ + 1;
+      const uint32_t maximum_distance_sketch = _getMaximumDistanceSketch(maximum_distance);
+
+      // ds scratch buffers reused over queries
+      std::vector<std::pair<uint32_t, const Node*>> branches;
+      std::vector<const Node*> leafs;
+      for (size_t index_query = 0; index_query < queries_.size(); ++index_query) {
+        const Descriptor& descriptor_query = queries_.descriptor(index_query);
+        const uint64_t sketch_query        = Matchable::getSketch(descriptor_query);
+        _getLeafsToProbe(descriptor_query, maximum_distance, number_of_probes_, branches, leafs);
+
+        // ds collect all references within the radius in the probed leafs
+        const size_t index_match_begin = matches_.matches.size();
+        for (const Node* leaf : leafs) {
+          if (leaf->getDistanceLowerBound(descriptor_query) >= maximum_distance) {
+            continue;
+          }
+          for (size_t index_reference = 0; index_reference < leaf->getMatchables().size();
+               ++index_reference) {
+            if (!_isWithinSketchDistance(
+                  sketch_query, leaf->getSketches()[index_reference], maximum_distance_sketch)) {
+              continue;
+            }
+            const Matchable* matchable_reference = leaf->getMatchables()[index_reference];
+            const uint32_t distance              = Matchable::distanceBounded(
+              descriptor_query, matchable_reference->descriptor, maximum_distance);
+            if (distance < maximum_distance) {
+              matches_.matches.push_back(Match(queries_.matchable(index_query),
+                                               matchable_reference,
+                                               queries_.object(index_query),
+                                               matchable_reference->objects.begin()->second,
+                                               distance));
+            }
+          }
+        }
+
+        // ds order the matches of the query by distance and keep the nearest ones
+        std::stable_sort(
+          matches_.matches.begin() + index_match_begin,
+          matches_.matches.end(),
+          [](const Match& a_, const Match& b_) { return a_.distance < b_.distance; });
+        if (matches_.matches.size() - index_match_begin > maximum_number_of_matches_per_query_) {
+          matches_.matches.resize(index_match_begin + maximum_number_of_matches_per_query_);
+        }
+        matches_.offsets.push_back(matches_.matches.size());
+      }
+    }
+
+    //! @brief collects the leafs to scan for a query: its destination leaf followed by up to
+    //! number_of_probes_ leafs reached by flipping a single split decision on the descent path -
+    //! branches are probed in order of their distance lower bound (unreachable ones are skipped)
+    //! @param[in] descriptor_query_ query descriptor
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] number_of_probes_ maximum number of additional leafs
+    //! @param[in,out] branches_ scratch buffer: distance lower bound, branch node
+    //! @param[out] leafs_ leafs to scan
+    void _getLeafsToProbe(const Descriptor& descriptor_query_,
+                          const uint32_t& maximum_distance_,
+                          const size_t& number_of_probes_,
+                          std::vector<std::pair<uint32_t, const Node*>>& branches_,
+                          std::vector<const Node*>& leafs_) const {
+      assert(_root);
+      leafs_.clear();
+      branches_.clear();
+
+      // ds regular descent - bookkeeping the branches not taken
+      const Node* node_current = _getRootSearch();
+      while (node_current->has_leafs) {
+        const Node* node_branch = nullptr;
+        if (descriptor_query_[node_current->index_split_bit]) {
+          node_branch  = node_current->left;
+          node_current = node_current->right;
+        } else {
+          node_branch  = node_current->right;
+          node_current = node_current->left;
+        }
+        if (number_of_probes_ > 0) {
+          // ds the flipped split bit mismatches in any case - this is the only bound available
+          // for internal nodes without summary
+          const uint32_t distance_lower_bound =
+            std::max(node_branch->getDistanceLowerBound(descriptor_query_), uint32_t(1));
+          if (distance_lower_bound < maximum_distance_) {
+            branches_.emplace_back(distance_lower_bound, node_branch);
+          }
+        }
+      }
+      leafs_.push_back(node_current);
+
+      // ds descend regularly from the most promising branches - equal bounds keep the descent
+      // order (shallow branches first) for deterministic results
+      const size_t number_of_branches = std::min(number_of_probes_, branches_.size());
+      std::stable_sort(branches_.begin(),
+                       branches_.end(),
+                       [](const std::pair<uint32_t, const Node*>& a_,
+                          const std::pair<uint32_t, const Node*>& b_) {
+                         return a_.first < b_.first;
+                       });
+      for (size_t index_branch = 0; index_branch < number_of_branches; ++index_branch) {
+        node_current = branches_[index_branch].second;
+        while (node_current->has_leafs) {
+          if (descriptor_query_[node_current->index_split_bit]) {
+            node_current = node_current->right;
+          } else {
+            node_current = node_current->left;
+          }
+        }
+        leafs_.push_back(node_current);
+      }
+    }
+
+    //! @brief leaf-major matching of a query batch (see matchBatch and matchLazyBatch)
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[out] matches_ output matching results in query order
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in] lazy_ if set, the first reference within maximum_distance_ is accepted
+    template <typename QueriesType_>
+    void _matchBatch(const QueriesType_& queries_,
+                     MatchVector& matches_,
+                     const uint32_t& maximum_distance_,
+                     const bool& lazy_) const {
+      _waitForInsertion();
+      if (queries_.size() == 0 || !_root) {
+        return;
+      }
+      const size_t number_of_queries = queries_.size();
+
+      // ds descend all queries first (cheap) and group them by destination leaf
+      std::vector<const Node*> leafs(number_of_queries);
+      for (size_t index_begin = 0; index_begin < number_of_queries;
+           index_begin += number_of_queries_interleaved) {
+        _descend(queries_,
+                 index_begin,
+                 std::min(index_begin + number_of_queries_interleaved, number_of_queries),
+                 &leafs[index_begin]);
+      }
+      std::vector<uint32_t> indices_query(number_of_queries);
+      for (size_t index_query = 0; index_query < number_of_queries; ++index_query) {
+        indices_query[index_query] = index_query;
+      }
+      std::sort(indices_query.begin(),
+                indices_query.end(),
+                [&leafs](const uint32_t& a, const uint32_t& b) {
+                  return leafs[a] < leafs[b] || (leafs[a] == leafs[b] && a < b);
+                });
+
+      // ds best candidates per query (a reference is only accepted below the distance bound)
+      std::vector<uint32_t> distances_best(number_of_queries, maximum_distance_);
+      std::vector<const Matchable*> matchables_reference_best(number_of_queries, nullptr);
+      const uint32_t maximum_distance_sketch = _getMaximumDistanceSketch(maximum_distance_);
+
+      // ds scan each leaf once for its whole bucket of queries - in blocks of references
+      size_t index_bucket_begin = 0;
+      while (index_bucket_begin < number_of_queries) {
+        const Node* leaf        = leafs[indices_query[index_bucket_begin]];
+        size_t index_bucket_end = index_bucket_begin + 1;
+        while (index_bucket_end < number_of_queries &&
+               leafs[indices_query[index_bucket_end]] == leaf) {
+          ++index_bucket_end;
+        }
+        const MatchableVector& matchables_reference = leaf->getMatchables();
+        const std::vector<uint64_t>& sketches_reference = leaf->getSketches();
+
+        // ds queries that cannot reach any reference of the leaf accept no distance
+        for (size_t index_bucket = index_bucket_begin; index_bucket < index_bucket_end;
+             ++index_bucket) {
+          const uint32_t index_query = indices_query[index_bucket];
+          if (leaf->getDistanceLowerBound(queries_.descriptor(index_query)) >= maximum_distance_) {
+            distances_best[index_query] = 0;
+          }
+        }
+        for (size_t index_block_begin = 0; index_block_begin < matchables_reference.size();
+             index_block_begin += number_of_references_per_block) {
+          const size_t index_block_end = std::min(
+            index_block_begin + number_of_references_per_block, matchables_reference.size());
+          for (size_t index_bucket = index_bucket_begin; index_bucket < index_bucket_end;
+               ++index_bucket) {
+            const uint32_t index_query         = indices_query[index_bucket];
+            const Descriptor& descriptor_query = queries_.descriptor(index_query);
+
+            // ds lazy queries are settled by their first reference below the threshold
+            if (lazy_ && matchables_reference_best[index_query]) {
+              continue;
+            }
+            const uint64_t sketch_query = Matchable::getSketch(descriptor_query);
+            for (size_t index_reference = index_block_begin; index_reference < index_block_end;
+                 ++index_reference) {
+              if (!_isWithinSketchDistance(
+                    sketch_query, sketches_reference[index_reference], maximum_distance_sketch)) {
+                continue;
+              }
+              const Matchable* matchable_reference = matchables_reference[index_reference];
+              const uint32_t distance = Matchable::distanceBounded(
+                descriptor_query, matchable_reference->descriptor, distances_best[index_query]);
+              if (distance < distances_best[index_query]) {
+                distances_best[index_query]            = distance;
+                matchables_reference_best[index_query] = matchable_reference;
+                if (lazy_) {
+                  break;
+                }
+              }
+            }
+          }
+        }
+        index_bucket_begin = index_bucket_end;
+      }
+
+      // ds emit matches in query order
+      for (size_t index_query = 0; index_query < number_of_queries; ++index_query) {
+        const Matchable* matchable_reference = matchables_reference_best[index_query];
+        if (matchable_reference) {
+          matches_.push_back(Match(queries_.matchable(index_query),
+                                   matchable_reference,
+                                   queries_.object(index_query),
+                                   matchable_reference->objects.begin()->second,
+                                   distances_best[index_query]));
+        }
+      }
+    }
+
+    //! @brief accumulates image votes for a range of queries (see getTopKImages)
+    //! @param[in] queries_ query access (MatchableQueries or DescriptorQueries)
+    //! @param[in] index_begin_ first query index to process
+    //! @param[in] index_end_ query index after the last to process
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @param[in,out] votes_ vote histogram: image id, vote
+    //! @param[in] image_filter_ optional eligible reference images (see ImageFilter)
+    template <typename QueriesType_>
+    void _accumulateVotes(const QueriesType_& queries_,
+                          const size_t& index_begin_,
+                          const size_t& index_end_,
+                          const uint32_t& maximum_distance_,
+                          VoteHistogram& votes_,
+                          const ImageFilter* image_filter_ = nullptr) const {
+      const uint32_t maximum_distance_sketch = _getMaximumDistanceSketch(maximum_distance_);
+      const Node* leafs[number_of_queries_interleaved];
+      for (size_t index_query = index_begin_; index_query < index_end_; ++index_query) {
+        const Descriptor& descriptor_query = queries_.descriptor(index_query);
+
+        // ds traverse tree to find the leafs for the next group of descriptors
+        const size_t index_group = (index_query - index_begin_) % number_of_queries_interleaved;
+        if (index_group == 0) {
+          _descend(queries_,
+                   index_query,
+                   std::min(index_query + number_of_queries_interleaved, index_end_),
+                   leafs);
+        }
+
+        // ds check current descriptors for each reference image in this leaf
+        const Node* leaf = leafs[index_group];
+        if (leaf->getDistanceLowerBound(descriptor_query) >= maximum_distance_ ||
+            (image_filter_ && !_isEligible(*image_filter_, leaf))) {
+          continue;
+        }
+        const uint64_t sketch_query = Matchable::getSketch(descriptor_query);
+        for (size_t index_reference = 0; index_reference < leaf->getMatchables().size();
+             ++index_reference) {
+          if (!_isWithinSketchDistance(
+                sketch_query, leaf->getSketches()[index_reference], maximum_distance_sketch)) {
+            continue;
+          }
+          const Matchable* matchable_reference = leaf->getMatchables()[index_reference];
+          if (image_filter_ && !_isEligible(*image_filter_, matchable_reference)) {
+            continue;
+          }
+          if (Matchable::distanceBounded(
+                descriptor_query, matchable_reference->descriptor, maximum_distance_) <
+              maximum_distance_) {
+#ifdef SRRG_MERGE_DESCRIPTORS
+            for (const typename ObjectMap::value_type& object : matchable_reference->objects) {
+              if (image_filter_ && !image_filter_->isEligible(object.first)) {
+                continue;
+              }
+              Vote& vote = votes_[object.first];
+#else
+            Vote& vote = votes_[matchable_reference->_image_identifier];
+#endif
+
+              // ds the query matchable can be matched only once to each reference image
+              if (vote.index_query_last != index_query) {
+                ++vote.number_of_matches;
+                vote.index_query_last = index_query;
+              }
+#ifdef SRRG_MERGE_DESCRIPTORS
+            }
+#endif
+          }
+        }
+      }
+    }
+
+    //! @brief sketch distance threshold of a leaf scan (see Configuration::sketch_distance_ratio)
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    //! @returns references with a sketch distance of at least this value are skipped
+    uint32_t _getMaximumDistanceSketch(const uint32_t& maximum_distance_) const {
+      if (_configuration.sketch_distance_ratio <= 0) {
+        return std::numeric_limits<uint32_t>::max();
+      }
+      return static_cast<uint32_t>(
+        std::ceil(_configuration.sketch_distance_ratio * maximum_distance_));
+    }
+
+    //! @brief first stage of a leaf scan: checks whether a reference passes the sketch prefilter
+    static bool _isWithinSketchDistance(const uint64_t& sketch_query_,
+                                        const uint64_t& sketch_reference_,
+                                        const uint32_t& maximum_distance_sketch_) {
+      return Matchable::getNumberOfSetBits(sketch_query_ ^ sketch_reference_) <
+             maximum_distance_sketch_;
+    }
+
+    //! @brief includes a descriptor added to a leaf in the bit summaries of the leaf and all of
+    //! its parents (if summarized)
+    //! @param[in] leaf_ leaf the descriptor has been added to
+    //! @param[in] descriptor_ added descriptor
+    static void _updateBitSummaries(Node* leaf_, const Descriptor& descriptor_) {
+      for (Node* node = leaf_; node && node->summary; node = node->parent) {
+        node->updateBitSummaries(descriptor_);
+      }
+    }
+
+    //! @brief includes an image referenced in a leaf in the image ranges of the leaf and all of
+    //! its parents (if summarized)
+    //! @param[in] leaf_ leaf the image has been added to (inserted or merged)
+    //! @param[in] identifier_image_ image identifier
+    static void _updateImageRanges(Node* leaf_, const uint64_t& identifier_image_) {
+      for (Node* node = leaf_; node && node->summary; node = node->parent) {
+        node->updateImageRange(identifier_image_);
+      }
+    }
+
+    //! @brief recomputes the bit summaries and image ranges of a subtree (e.g. after loading) -
+    //! internal nodes are summarized only if configured
+    //! @param[in] node_ subtree root
+    void _computeSummaries(Node* node_) const {
+      if (node_->has_leafs) {
+        _computeSummaries(node_->left);
+        _computeSummaries(node_->right);
+        delete node_->summary;
+        node_->summary = nullptr;
+        if (_configuration.summarize_internal_nodes) {
+          const typename Node::Summary& summary_left  = *node_->left->summary;
+          const typename Node::Summary& summary_right = *node_->right->summary;
+          node_->summary = new typename Node::Summary();
+          node_->summary->bits_set_in_all =
+            summary_left.bits_set_in_all & summary_right.bits_set_in_all;
+          node_->summary->bits_set_in_any =
+            summary_left.bits_set_in_any | summary_right.bits_set_in_any;
+          node_->summary->identifier_image_minimum =
+            std::min(summary_left.identifier_image_minimum, summary_right.identifier_image_minimum);
+          node_->summary->identifier_image_maximum =
+            std::max(summary_left.identifier_image_maximum, summary_right.identifier_image_maximum);
+        }
+      } else {
+        *static_cast<typename Node::Summary*>(node_->_getStorage()) = typename Node::Summary();
+        for (const Matchable* matchable : node_->getMatchables()) {
+          node_->updateBitSummaries(matchable->descriptor);
+          for (const typename ObjectMap::value_type& object : matchable->objects) {
+            node_->updateImageRange(object.first);
+          }
+        }
+      }
+    }
+
+    //! @brief checks whether a subtree may reference an eligible image
+    static bool _isEligible(const ImageFilter& image_filter_, const Node* node_) {
+      return image_filter_.isEligible(node_->getIdentifierImageMinimum(),
+                                      node_->getIdentifierImageMaximum());
+    }
+
+    //! @brief checks whether a reference matchable belongs to an eligible image
+    static bool _isEligible(const ImageFilter& image_filter_, const Matchable* matchable_) {
+#ifdef SRRG_MERGE_DESCRIPTORS
+      for (const typename ObjectMap::value_type& object : matchable_->objects) {
+        if (image_filter_.isEligible(object.first)) {
+          return true;
+        }
+      }
+      return false;
+#else
+      return image_filter_.isEligible(matchable_->_image_identifier);
+#endif
+    }
+
+    //! @brief reported object of a reference matchable: its first (eligible) object
+    static const ObjectType& _getObject(const Matchable* matchable_,
+                                        const ImageFilter* image_filter_) {
+      if (image_filter_) {
+        for (const typename ObjectMap::value_type& object : matchable_->objects) {
+          if (image_filter_->isEligible(object.first)) {
+            return object.second;
+          }
+        }
+      }
+      return matchable_->objects.begin()->second;
+    }
+
+    //! @brief checks splits for all leafs touched in the last insertion (_leafs_to_update) - each
+    //! leaf is checked once, in order of its first touch, after the leafs pending from previous
+    //! calls (independent of node addresses: random splitting is reproducible for a seed)
+    //! @param[in] train_mode_ splitting strategy
+    void _spawnLeafs(const SplittingStrategy& train_mode_) {
+      _leafs_to_update_indexed.clear();
+      for (size_t index_leaf = 0; index_leaf < _leafs_to_update.size(); ++index_leaf) {
+        _leafs_to_update_indexed.push_back(
+          std::make_pair(_leafs_to_update[index_leaf], index_leaf));
+      }
+
+      // ds keep the first touch of every leaf and restore the touch order
+      std::sort(_leafs_to_update_indexed.begin(), _leafs_to_update_indexed.end());
+      _leafs_to_update_indexed.erase(
+        std::unique(_leafs_to_update_indexed.begin(),
+                    _leafs_to_update_indexed.end(),
+                    [](const std::pair<Node*, size_t>& a_, const std::pair<Node*, size_t>& b_) {
+                      return a_.first == b_.first;
+                    }),
+        _leafs_to_update_indexed.end());
+      std::sort(_leafs_to_update_indexed.begin(),
+                _leafs_to_update_indexed.end(),
+                [](const std::pair<Node*, size_t>& a_, const std::pair<Node*, size_t>& b_) {
+                  return a_.second < b_.second;
+                });
+      _leafs_to_update.clear();
+      for (const std::pair<Node*, size_t>& leaf_indexed : _leafs_to_update_indexed) {
+        _leafs_to_update.push_back(leaf_indexed.first);
+      }
+      _addPendingLeafs(_leafs_to_update);
+      _leafs_to_update.clear();
+      _splitPendingLeafs(train_mode_, _configuration.maximum_number_of_splits_per_call);
+    }
+
+    //! @brief appends leafs to the pending split checks (leafs already pending are skipped)
+    //! @param[in] leafs_ unique leafs to append
+    void _addPendingLeafs(const std::vector<Node*>& leafs_) {
+      const size_t number_of_leafs_pending = _leafs_to_split.size();
+      for (Node* leaf : leafs_) {
+        if (std::find(_leafs_to_split.begin(),
+                      _leafs_to_split.begin() + number_of_leafs_pending,
+                      leaf) == _leafs_to_split.begin() + number_of_leafs_pending) {
+          _leafs_to_split.push_back(leaf);
+        }
+      }
+    }
+
+    //! @brief checks pending leafs for splits in queue order until the split budget is used up -
+    //! leafs that remain pending stay regular leafs (updated for matching and serialization)
+    //! @param[in] train_mode_ splitting strategy
+    //! @param[in] maximum_number_of_splits_ maximum number of leaf splits (recursive per leaf)
+    void _splitPendingLeafs(const SplittingStrategy& train_mode_,
+                            const size_t& maximum_number_of_splits_) {
+      size_t number_of_splits = 0;
+      size_t index_leaf       = 0;
+      while (index_leaf < _leafs_to_split.size() && number_of_splits < maximum_number_of_splits_) {
+        Node* leaf = _leafs_to_split[index_leaf];
+        ++index_leaf;
+        if (!leaf->has_leafs && leaf->spawnLeafs(train_mode_)) {
+          ++number_of_splits;
+        }
+      }
+      _leafs_to_split.erase(_leafs_to_split.begin(), _leafs_to_split.begin() + index_leaf);
+      for (Node* leaf : _leafs_to_split) {
+        leaf->_getStorage()->header.number_of_matchables_compressed = leaf->getMatchables().size();
+      }
+    }
+
+#ifdef SRRG_MERGE_DESCRIPTORS
+    //! @brief checks if a reference matchable already absorbed a matchable in the current call
+    //! @param[in] matchable_reference_ reference matchable
+    //! @returns true if the reference has been merged already
+    bool _isMergedReference(const Matchable* matchable_reference_) const {
+      return std::binary_search(_merged_reference_matchables.begin(),
+                                _merged_reference_matchables.end(),
+                                matchable_reference_);
+    }
+
+    //! @brief registers a merged reference matchable (sorted insertion)
+    //! @param[in] matchable_reference_ reference matchable
+    void _addMergedReference(const Matchable* matchable_reference_) {
+      _merged_reference_matchables.insert(std::lower_bound(_merged_reference_matchables.begin(),
+                                                           _merged_reference_matchables.end(),
+                                                           matchable_reference_),
+                                          matchable_reference_);
+    }
+#endif
+
+    //! @brief recursively counts all leafs and descriptors stored in the tree (expensive)
+    //! @param[in] starting node (only subtree will be evaluated)
+    //! @param[out] number_of_leafs_
+    //! @param[out] number_of_matchables_
+    //! @param[out] leafs_
+    void _getLeafs(Node* node_,
+                   uint64_t& number_of_leafs_,
+                   uint64_t& number_of_matchables_,
+                   std::vector<const Node*>& leafs_) const {
+      // ds handle call on empty tree without node_ == _root
+      if (_root == nullptr) {
+        number_of_leafs_      = 0;
+        number_of_matchables_ = 0;
+        leafs_.clear();
+        return;
+      }
+
+      // ds if we are in a node (that has leafs)
+      if (node_->has_leafs) {
+        assert(node_->right);
+        assert(node_->left);
+
+        // ds look deeper on left and right subtree
+        _getLeafs(node_->left, number_of_leafs_, number_of_matchables_, leafs_);
+        _getLeafs(node_->right, number_of_leafs_, number_of_matchables_, leafs_);
+
+      } else {
+        // ds we reached a leaf
+        assert(!node_->right);
+        assert(!node_->left);
+
+        // ds update statistics and terminate recursion
+        ++number_of_leafs_;
+        number_of_matchables_ += node_->getMatchables().size();
+        leafs_.push_back(node_);
+      }
+    }
 
     // ds public attributes
   public:
 #ifdef SRRG_MERGE_DESCRIPTORS
-    //! @brief maximum allowed descriptor distance for merging two descriptors
+    //! @brief default maximum allowed descriptor distance for merging two descriptors (see
+    //! Configuration)
     static uint32_t maximum_distance_for_merge;
 #endif
 
+    //! @brief default maximum number of leaf splits per insertion call (train, add, matchAndAdd) -
+    //! leafs beyond the budget stay pending until a later call or splitPendingLeafs (default: no
+    //! limit, see Configuration)
+    static size_t maximum_number_of_splits_per_call;
+
+    //! @brief default sketch prefilter of leaf scans: a reference is only compared in full if its
+    //! sketch distance (see BinaryMatchable::getSketch) is below sketch_distance_ratio times the
+    //! matching threshold - 1 is lossless (the sketch distance is a lower bound), smaller values
+    //! trade recall for speed, 0 disables the prefilter (see Configuration)
+    static double sketch_distance_ratio;
+
+    //! @brief default linear search threshold: while the tree stores fewer matchables, all queries
+    //! scan a single leaf referencing all matchables instead of descending the tree (exact
+    //! results of match, e.g. for the first images or small maps) - 0 disables the linear search,
+    //! std::numeric_limits<size_t>::max() always uses it (see Configuration)
+    static size_t maximum_number_of_matchables_linear_search;
+
+    //! @brief default handling of queries issued while a matchAndAddAsync insertion is pending:
+    //! they wait for its completion (and see the inserted matchables) - if disabled the caller has
+    //! to synchronize() before any query (see Configuration)
+    static bool wait_for_insertion;
+
     // ds attributes
   protected:
+    //! @brief number of leaf references compared against a query bucket at once (matchBatch)
+    static constexpr size_t number_of_references_per_block = 64;
+
+    //! @brief number of queries descended in lockstep with interleaved prefetching (_descend)
+    static constexpr size_t number_of_queries_interleaved = 16;
+
+    //! @brief number of striped leaf locks for concurrent insertion (addConcurrent)
+    static constexpr size_t number_of_leaf_locks = 64;
+
+    //! @brief configuration of this tree, shared by all of its nodes (see Configuration)
+    Configuration _configuration;
+
     //! @brief serializable header carrying core attributes
     mutable Header _header;
 
     //! @brief root node (e.g. starting point for similarity search)
     Node* _root = nullptr;
 
+    //! @brief identifier of the current tree structure - changes whenever nodes are freed
+    uint64_t _identifier_structure = _getNextIdentifierStructure();
+
     //! @brief bookkeeping: all matchables contained in the tree
     MatchableVector _matchables;
     MatchableVector _matchables_to_train;
 
+    //! @brief single leaf referencing all matchables (same order as _matchables), kept only for
+    //! the linear search (see Configuration) - contiguous sketches, no descent
+    Node* _leaf_linear = nullptr;
+    typename Node::Configuration _configuration_linear;
+
     //! @brief bookkeeping: integrated matchable train identifiers (unique)
     std::set<uint64_t> _added_identifiers_train;
 
     //! @brief bookkeeping: trainable matchables resulting from last matchAndAdd call
     std::vector<Trainable> _trainables;
 
+    //! @brief scratch buffers reused over insertion calls (steady-state insertion without
+    //! allocations): leafs touched by the insertion and best match candidates of a query
+    std::vector<Node*> _leafs_to_update;
+    std::vector<std::pair<Node*, size_t>> _leafs_to_update_indexed;
+    BestMatchVector _best_matches;
+
+    //! @brief bookkeeping: touched leafs waiting for their split check in queue order (see
+    //! Configuration::maximum_number_of_splits_per_call)
+    std::vector<Node*> _leafs_to_split;
+
+    //! @brief concurrent insertion (addConcurrent): shared access for descents and leaf
+    //! insertions, exclusive access for structural changes (root creation and leaf splits)
+#if __cplusplus >= 201703L
+    using MutexStructure = std::shared_mutex;
+#elif __cplusplus >= 201402L
+    using MutexStructure = std::shared_timed_mutex;
+#endif
+#if __cplusplus >= 201402L
+    using LockStructureShared = std::shared_lock<MutexStructure>;
+#else
+    // ds no shared locks before c++14: concurrent descents and leaf insertions are serialized
+    using MutexStructure      = std::mutex;
+    using LockStructureShared = std::unique_lock<MutexStructure>;
+#endif
+    MutexStructure _mutex_structure;
+
+    //! @brief concurrent insertion: striped leaf content locks and tree bookkeeping lock
+    mutable std::mutex _mutexes_leafs[number_of_leaf_locks];
+    std::mutex _mutex_bookkeeping;
+
+    //! @brief background stage of the last matchAndAddAsync call
+    std::future<void> _insertion;
+
 #ifdef SRRG_MERGE_DESCRIPTORS
     //! @brief bookkeeping: merged matchable pairs (query -> reference) resulting from last
     //! matchAndAdd call over Mergable.query one has access to the merged (=freed) matchable and can
     //! update external bookkeeping accordingly
     MatchableMergeVector _merged_matchables;
 
+    //! @brief scratch buffer: reference matchables merged in the current call (sorted)
+    std::vector<const Matchable*> _merged_reference_matchables;
+
     //! statistics
     size_t _number_of_merged_matchables_last_training = 0;
+
+    //! @brief number of merged (=freed) matchables since the last clear
+    size_t _number_of_merged_matchables_total = 0;
 #endif
   };
 
@@ -1486,6 +4193,23 @@ namespace srrg_hbst {
   template <typename BinaryNodeType_>
   uint32_t BinaryTree<BinaryNodeType_>::maximum_distance_for_merge = 0;
 #endif
+  template <typename BinaryNodeType_>
+  size_t BinaryTree<BinaryNodeType_>::maximum_number_of_splits_per_call =
+    std::numeric_limits<size_t>::max();
+  template <typename BinaryNodeType_>
+  double BinaryTree<BinaryNodeType_>::sketch_distance_ratio = 1;
+  template <typename BinaryNodeType_>
+  size_t BinaryTree<BinaryNodeType_>::maximum_number_of_matchables_linear_search = 0;
+  template <typename BinaryNodeType_>
+  bool BinaryTree<BinaryNodeType_>::wait_for_insertion = true;
+
+  // ds come on c++11
+  template <typename BinaryNodeType_>
+  constexpr size_t BinaryTree<BinaryNodeType_>::number_of_references_per_block;
+  template <typename BinaryNodeType_>
+  constexpr size_t BinaryTree<BinaryNodeType_>::number_of_queries_interleaved;
+  template <typename BinaryNodeType_>
+  constexpr size_t BinaryTree<BinaryNodeType_>::number_of_leaf_locks;
 
   template <typename ObjectType_>
   using BinaryTree128 = BinaryTree<BinaryNode128<ObjectType_>>;
@@ -19,7 +19,7 @@ namespace srrg_hbst {
     typedef typename Matchable::Descriptor Descriptor;
     typedef std::vector<Matchable*> MatchableVector;
     typedef real_precision_ precision;
-    typedef BinaryMatch<Matchable, precision> Match;
+    typedef BinaryMatch<Matchable> Match;
     typedef typename Matchable::BitStatisticsVector BitStatisticsVector;
 
     // ds ctor/dtor
@@ -0,0 +1,371 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "srrg_hbst/types/binary_tree.hpp"
+
+namespace srrg_hbst {
+
+  //! @class offline tuning of the tree configuration (maximum_leaf_size, maximum_partitioning)
+  //! and the splitting strategy on a sample of training and query descriptors: every parameter
+  //! combination is built and queried (in parallel) and compared to a brute-force ground truth
+  //! @param BinaryTreeType_ tree type to tune (its ObjectType must be default constructible)
+  template <typename BinaryTreeType_>
+  class BinaryTreeTuner {
+    // ds exports
+  public:
+    using Tree              = BinaryTreeType_;
+    using Configuration     = typename Tree::Configuration;
+    using Node              = typename Tree::Node;
+    using Matchable         = typename Tree::Matchable;
+    using MatchableVector   = typename Tree::MatchableVector;
+    using Descriptor        = typename Tree::Descriptor;
+    using DescriptorQueries = typename Tree::DescriptorQueries;
+    using ObjectType        = typename Tree::ObjectType;
+    using real_type         = typename Tree::real_type;
+
+    //! @brief a tuned parameter combination and its measured performance
+    struct Candidate {
+      //! @brief tree configuration and splitting strategy used for building
+      Configuration configuration;
+      SplittingStrategy splitting_strategy = SplittingStrategy::SplitEven;
+
+      //! @brief fraction of queries matched to a reference at the brute-force nearest distance
+      double recall = 0;
+
+      //! @brief mean duration of a query (match) in seconds
+      double duration_query_seconds = 0;
+
+      //! @brief duration of building the tree from all training images in seconds
+      double duration_build_seconds = 0;
+
+      //! @brief estimated memory occupied by the tree (nodes, matchables and leaf storage)
+      size_t memory_bytes = 0;
+
+      //! @brief set if no other candidate is at least as good in all measures and better in one
+      bool is_pareto_optimal = false;
+    };
+    using CandidateVector = std::vector<Candidate>;
+
+    // ds ctor/dtor
+  public:
+    //! @brief constructs a tuner on a descriptor sample (copied)
+    //! @param[in] descriptors_train_per_image_ training descriptors, added image by image
+    //! @param[in] descriptors_query_ query descriptors
+    //! @param[in] maximum_distance_ the maximum distance allowed for a positive match response
+    BinaryTreeTuner(const std::vector<std::vector<Descriptor>>& descriptors_train_per_image_,
+                    const std::vector<Descriptor>& descriptors_query_,
+                    const uint32_t& maximum_distance_ = 25) :
+      _descriptors_train_per_image(descriptors_train_per_image_),
+      _descriptors_query(descriptors_query_),
+      _objects_query(descriptors_query_.size()),
+      _maximum_distance(maximum_distance_) {
+    }
+
+    // ds access
+  public:
+    //! @brief builds and queries a tree for every combination of the swept parameters
+    //! @returns all candidates with their measures, Pareto optimal candidates are flagged
+    CandidateVector tune() {
+      _computeGroundTruth();
+
+      // ds enumerate all parameter combinations
+      CandidateVector candidates;
+      for (const SplittingStrategy& splitting_strategy : splitting_strategies) {
+        for (const uint64_t& maximum_leaf_size : maximum_leaf_sizes) {
+          for (const real_type& maximum_partitioning : maximum_partitionings) {
+            Candidate candidate;
+            candidate.configuration                      = configuration_base;
+            candidate.configuration.maximum_leaf_size    = maximum_leaf_size;
+            candidate.configuration.maximum_partitioning = maximum_partitioning;
+            candidate.splitting_strategy                 = splitting_strategy;
+            candidates.push_back(candidate);
+          }
+        }
+      }
+
+      // ds evaluate candidates on worker threads (each candidate builds its own tree)
+      std::atomic<size_t> index_candidate_next(0);
+      _runParallel([this, &candidates, &index_candidate_next]() {
+        for (size_t index_candidate = index_candidate_next++; index_candidate < candidates.size();
+             index_candidate        = index_candidate_next++) {
+          _evaluate(candidates[index_candidate]);
+        }
+      });
+      _computeParetoFront(candidates);
+      return candidates;
+    }
+
+    //! @brief selects the Pareto optimal candidate with the fastest queries among those reaching
+    //! minimum_recall - or the one with the highest recall if none does
+    //! @param[in] candidates_ evaluated candidates (see tune)
+    //! @returns recommended candidate (default candidate if there are none)
+    const Candidate getRecommendedCandidate(const CandidateVector& candidates_) const {
+      const Candidate* candidate_best = nullptr;
+      for (const Candidate& candidate : candidates_) {
+        if (!candidate.is_pareto_optimal || candidate.recall < minimum_recall) {
+          continue;
+        }
+        if (!candidate_best ||
+            candidate.duration_query_seconds < candidate_best->duration_query_seconds) {
+          candidate_best = &candidate;
+        }
+      }
+      if (!candidate_best) {
+        for (const Candidate& candidate : candidates_) {
+          if (!candidate_best || candidate.recall > candidate_best->recall) {
+            candidate_best = &candidate;
+          }
+        }
+      }
+      return candidate_best ? *candidate_best : Candidate();
+    }
+
+    //! @brief prints the Pareto front (or all candidates) and the recommended configuration
+    //! @param[in] stream_ output stream
+    //! @param[in] candidates_ evaluated candidates (see tune)
+    //! @param[in] print_all_candidates_ print dominated candidates as well
+    void writeReport(std::ostream& stream_,
+                     const CandidateVector& candidates_,
+                     const bool& print_all_candidates_ = false) const {
+      const std::streamsize precision = stream_.precision();
+      stream_ << "BinaryTreeTuner|queries: " << _descriptors_query.size()
+              << " | maximum distance: " << _maximum_distance << std::endl;
+      stream_ << "  pareto | strategy | leaf size | partitioning | recall | query (us) | "
+                 "build (ms) | memory (kB)"
+              << std::endl;
+      for (const Candidate& candidate : candidates_) {
+        if (!print_all_candidates_ && !candidate.is_pareto_optimal) {
+          continue;
+        }
+        stream_ << std::setw(8) << (candidate.is_pareto_optimal ? "*" : "") << " | "
+                << std::setw(8) << getName(candidate.splitting_strategy) << " | " << std::setw(9)
+                << candidate.configuration.maximum_leaf_size << " | " << std::setw(12)
+                << candidate.configuration.maximum_partitioning << " | " << std::setw(6)
+                << std::fixed << std::setprecision(3) << candidate.recall << " | "
+                << std::setw(10) << candidate.duration_query_seconds * 1e6 << " | "
+                << std::setw(10) << candidate.duration_build_seconds * 1e3 << " | "
+                << std::setw(11) << candidate.memory_bytes / 1024 << std::defaultfloat
+                << std::setprecision(precision) << std::endl;
+      }
+      const Candidate candidate_recommended = getRecommendedCandidate(candidates_);
+      stream_ << "BinaryTreeTuner|recommended: maximum_leaf_size = "
+              << candidate_recommended.configuration.maximum_leaf_size
+              << ", maximum_partitioning = "
+              << candidate_recommended.configuration.maximum_partitioning
+              << ", strategy = " << getName(candidate_recommended.splitting_strategy)
+              << std::endl;
+    }
+
+    //! @brief readable splitting strategy name
+    static const char* getName(const SplittingStrategy& splitting_strategy_) {
+      switch (splitting_strategy_) {
+        case SplittingStrategy::DoNothing: {
+          return "none";
+        }
+        case SplittingStrategy::SplitEven: {
+          return "even";
+        }
+        case SplittingStrategy::SplitUneven: {
+          return "uneven";
+        }
+        case SplittingStrategy::SplitRandomUniform: {
+          return "random";
+        }
+        default: { return "unknown"; }
+      }
+    }
+
+    //! @brief brute-force nearest distance per query (maximum_distance if there is none)
+    const std::vector<uint32_t>& getDistancesGroundTruth() const {
+      return _distances_ground_truth;
+    }
+
+    // ds helpers
+  protected:
+    //! @brief runs a task on number_of_threads threads (at least one)
+    template <typename TaskType_>
+    void _runParallel(TaskType_&& task_) const {
+      const size_t number_of_threads = std::max(number_of_threads_tuning, static_cast<size_t>(1));
+      std::vector<std::thread> workers;
+      workers.reserve(number_of_threads);
+      for (size_t index_thread = 0; index_thread < number_of_threads; ++index_thread) {
+        workers.emplace_back(task_);
+      }
+      for (std::thread& worker : workers) {
+        worker.join();
+      }
+    }
+
+    //! @brief computes the brute-force nearest distance of every query (ground truth)
+    void _computeGroundTruth() {
+      _distances_ground_truth.assign(_descriptors_query.size(), _maximum_distance);
+      std::atomic<size_t> index_query_next(0);
+      _runParallel([this, &index_query_next]() {
+        for (size_t index_query = index_query_next++; index_query < _descriptors_query.size();
+             index_query        = index_query_next++) {
+          uint32_t& distance_best = _distances_ground_truth[index_query];
+          for (const std::vector<Descriptor>& descriptors_train : _descriptors_train_per_image) {
+            for (const Descriptor& descriptor_train : descriptors_train) {
+              distance_best = std::min(distance_best,
+                                       Matchable::distanceBounded(_descriptors_query[index_query],
+                                                                  descriptor_train,
+                                                                  distance_best));
+            }
+          }
+        }
+      });
+    }
+
+    //! @brief builds and queries a tree with the parameters of a candidate
+    //! @param[in,out] candidate_ candidate to evaluate (measures are set)
+    void _evaluate(Candidate& candidate_) const {
+      using Clock = std::chrono::steady_clock;
+
+      // ds allocate all training matchables beforehand (the tree takes ownership)
+      std::vector<MatchableVector> matchables_per_image(_descriptors_train_per_image.size());
+      for (size_t index_image = 0; index_image < _descriptors_train_per_image.size();
+           ++index_image) {
+        for (const Descriptor& descriptor : _descriptors_train_per_image[index_image]) {
+          matchables_per_image[index_image].push_back(
+            new Matchable(ObjectType(), descriptor, index_image));
+        }
+      }
+
+      // ds build tree image by image
+      Tree tree(candidate_.configuration);
+      const Clock::time_point time_begin_build = Clock::now();
+      for (const MatchableVector& matchables : matchables_per_image) {
+        tree.add(matchables, candidate_.splitting_strategy);
+      }
+      candidate_.duration_build_seconds =
+        std::chrono::duration<double>(Clock::now() - time_begin_build).count();
+      candidate_.memory_bytes = _getMemoryBytes(tree.root());
+
+      // ds query all descriptors at once (streaming the matched distance of every query)
+      std::vector<uint32_t> distances_matched(_descriptors_query.size(), _maximum_distance);
+      const Clock::time_point time_begin_query = Clock::now();
+      tree.match(DescriptorQueries(_descriptors_query, _objects_query),
+                 _maximum_distance,
+                 [&distances_matched](const size_t& index_query_,
+                                      const Matchable* /*matchable_reference_*/,
+                                      const uint32_t& distance_) {
+                   distances_matched[index_query_] = distance_;
+                 });
+      candidate_.duration_query_seconds =
+        std::chrono::duration<double>(Clock::now() - time_begin_query).count() /
+        std::max(_descriptors_query.size(), static_cast<size_t>(1));
+
+      // ds a query is recalled if it is matched at the nearest distance
+      size_t number_of_queries_with_neighbor = 0;
+      size_t number_of_queries_recalled      = 0;
+      for (size_t index_query = 0; index_query < _descriptors_query.size(); ++index_query) {
+        if (_distances_ground_truth[index_query] < _maximum_distance) {
+          ++number_of_queries_with_neighbor;
+          if (distances_matched[index_query] == _distances_ground_truth[index_query]) {
+            ++number_of_queries_recalled;
+          }
+        }
+      }
+      candidate_.recall = number_of_queries_with_neighbor > 0 ?
+                            static_cast<double>(number_of_queries_recalled) /
+                              number_of_queries_with_neighbor :
+                            1;
+      tree.clear(true);
+    }
+
+    //! @brief estimates the memory occupied by a subtree (nodes, leaf storage and matchables)
+    //! @param[in] node_ subtree root
+    //! @returns number of bytes
+    static size_t _getMemoryBytes(const Node* node_) {
+      if (!node_) {
+        return 0;
+      }
+      if (node_->hasLeafs()) {
+        const size_t number_of_bytes_summary =
+          node_->hasSummary() ? sizeof(typename Node::Summary) : 0;
+        return sizeof(Node) + number_of_bytes_summary + _getMemoryBytes(node_->left) +
+               _getMemoryBytes(node_->right);
+      }
+      size_t number_of_bytes = sizeof(Node) + sizeof(typename Node::LeafStorage) +
+                               node_->getMatchables().capacity() * sizeof(Matchable*) +
+                               node_->getSketches().capacity() * sizeof(uint64_t);
+      for (const Matchable* matchable : node_->getMatchables()) {
+        number_of_bytes +=
+          sizeof(Matchable) +
+          matchable->objects.size() * sizeof(typename Matchable::ObjectMap::value_type);
+      }
+      return number_of_bytes;
+    }
+
+    //! @brief flags all candidates that are not dominated by another candidate
+    //! @param[in,out] candidates_ evaluated candidates
+    static void _computeParetoFront(CandidateVector& candidates_) {
+      for (Candidate& candidate : candidates_) {
+        candidate.is_pareto_optimal = true;
+        for (const Candidate& candidate_other : candidates_) {
+          if (_isDominating(candidate_other, candidate)) {
+            candidate.is_pareto_optimal = false;
+            break;
+          }
+        }
+      }
+    }
+
+    //! @brief checks whether a candidate is at least as good as another in all measures (higher
+    //! recall, lower query duration, build duration and memory) and better in at least one
+    static bool _isDominating(const Candidate& a_, const Candidate& b_) {
+      const bool is_not_worse = a_.recall >= b_.recall &&
+                                a_.duration_query_seconds <= b_.duration_query_seconds &&
+                                a_.duration_build_seconds <= b_.duration_build_seconds &&
+                                a_.memory_bytes <= b_.memory_bytes;
+      const bool is_better = a_.recall > b_.recall ||
+                             a_.duration_query_seconds < b_.duration_query_seconds ||
+                             a_.duration_build_seconds < b_.duration_build_seconds ||
+                             a_.memory_bytes < b_.memory_bytes;
+      return is_not_worse && is_better;
+    }
+
+    // ds public attributes (swept parameters)
+  public:
+    //! @brief swept maximum leaf sizes
+    std::vector<uint64_t> maximum_leaf_sizes = {25, 50, 100, 200, 400};
+
+    //! @brief swept maximum partitionings
+    std::vector<real_type> maximum_partitionings = {0.05, 0.1, 0.2, 0.3, 0.45};
+
+    //! @brief swept splitting strategies
+    std::vector<SplittingStrategy> splitting_strategies = {SplittingStrategy::SplitEven,
+                                                           SplittingStrategy::SplitUneven,
+                                                           SplittingStrategy::SplitRandomUniform};
+
+    //! @brief configuration for all remaining parameters (e.g. maximum_depth)
+    Configuration configuration_base;
+
+    //! @brief minimum recall of the recommended candidate (see getRecommendedCandidate)
+    double minimum_recall = 0.9;
+
+    //! @brief number of candidates evaluated in parallel - timings of concurrent builds and
+    //! queries are comparable among each other, use a single thread for absolute timings
+    size_t number_of_threads_tuning = std::max(std::thread::hardware_concurrency(), 1u);
+
+    // ds attributes
+  protected:
+    //! @brief descriptor sample
+    const std::vector<std::vector<Descriptor>> _descriptors_train_per_image;
+    const std::vector<Descriptor> _descriptors_query;
+    const std::vector<ObjectType> _objects_query;
+
+    //! @brief the maximum distance allowed for a positive match response
+    const uint32_t _maximum_distance;
+
+    //! @brief brute-force nearest distance per query
+    std::vector<uint32_t> _distances_ground_truth;
+  };
+
+} // namespace srrg_hbst
@@ -0,0 +1,207 @@
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <new>
+#include <random>
+#include <type_traits>
+
+#include "srrg_hbst/types/binary_tree.hpp"
+
+typedef srrg_hbst::BinaryTree256<size_t> Tree;
+using namespace srrg_hbst;
+
+// ds match records can be copied and reused without heap allocation
+static_assert(std::is_trivially_copyable<Tree::Match>::value, "Match must be trivially copyable");
+
+// ds the replaced global operators pair malloc and free (false positive once inlined)
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+// ds global heap allocation counter (only counting while enabled)
+static bool counting_allocations    = false;
+static size_t number_of_allocations = 0;
+
+void* operator new(std::size_t size_) {
+  if (counting_allocations) {
+    ++number_of_allocations;
+  }
+  void* memory = std::malloc(size_ == 0 ? 1 : size_);
+  if (!memory) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+void operator delete(void* memory_) noexcept {
+  std::free(memory_);
+}
+
+void operator delete(void* memory_, std::size_t /*size_*/) noexcept {
+  std::free(memory_);
+}
+
+int main(int argc_, char** argv_) {
+  testing::InitGoogleTest(&argc_, argv_);
+  return RUN_ALL_TESTS();
+}
+
+// ds random descriptors for a new image (allocated before counting)
+Tree::MatchableVector generateMatchables(std::mt19937& random_number_generator_,
+                                         const size_t& number_of_matchables_,
+                                         const uint64_t& identifier_image_) {
+  std::uniform_int_distribution<uint32_t> bit_distribution(0, 1);
+  Tree::MatchableVector matchables;
+  matchables.reserve(number_of_matchables_);
+  for (size_t index_descriptor = 0; index_descriptor < number_of_matchables_;
+       ++index_descriptor) {
+    Tree::Descriptor descriptor;
+    for (uint32_t index_bit = 0; index_bit < Tree::Matchable::descriptor_size_bits; ++index_bit) {
+      descriptor[index_bit] = bit_distribution(random_number_generator_);
+    }
+    matchables.emplace_back(new Tree::Matchable(index_descriptor, descriptor, identifier_image_));
+  }
+  return matchables;
+}
+
+// ds noisy re-observations of the given landmark descriptors (allocated before counting)
+Tree::MatchableVector observeMatchables(std::mt19937& random_number_generator_,
+                                        const std::vector<Tree::Descriptor>& descriptors_,
+                                        const uint64_t& identifier_image_) {
+  std::uniform_int_distribution<uint32_t> bit_distribution(
+    0, Tree::Matchable::descriptor_size_bits - 1);
+  Tree::MatchableVector matchables;
+  matchables.reserve(descriptors_.size());
+  for (size_t index_descriptor = 0; index_descriptor < descriptors_.size(); ++index_descriptor) {
+    Tree::Descriptor descriptor = descriptors_[index_descriptor];
+    for (uint32_t index_flip = 0; index_flip < 5; ++index_flip) {
+      descriptor.flip(bit_distribution(random_number_generator_));
+    }
+    matchables.emplace_back(new Tree::Matchable(index_descriptor, descriptor, identifier_image_));
+  }
+  return matchables;
+}
+
+// ds number of internal nodes of the tree (allocated nodes grow with it)
+size_t getNumberOfSplits(const Tree::Node* node_) {
+  if (!node_ || !node_->hasLeafs()) {
+    return 0;
+  }
+  return 1 + getNumberOfSplits(node_->left) + getNumberOfSplits(node_->right);
+}
+
+TEST(HBST, SteadyStateMatchAndAdd) {
+  // ds keep all descriptors in the root leaf - structural growth is not part of the test
+  Tree::Configuration configuration;
+  configuration.maximum_leaf_size = std::numeric_limits<uint64_t>::max();
+  std::mt19937 random_number_generator(0);
+  const size_t number_of_images               = 50;
+  const size_t number_of_images_warmup        = 5;
+  const size_t number_of_matchables_per_image = 200;
+
+  // ds stream images through the database, reusing the same output map
+  Tree database(configuration);
+  Tree::MatchVectorMap matches;
+  for (uint64_t identifier_image = 0; identifier_image < number_of_images; ++identifier_image) {
+    const Tree::MatchableVector matchables =
+      generateMatchables(random_number_generator, number_of_matchables_per_image, identifier_image);
+    number_of_allocations = 0;
+    counting_allocations  = true;
+    database.matchAndAdd(matchables, matches);
+    counting_allocations = false;
+
+    // ds in steady state only the bookkeeping of the new image may allocate (map entry and its
+    // match capacity, identifier) plus amortized growth of the matchable storage - independent
+    // of the number of queries and the number of images in the database
+    if (identifier_image >= number_of_images_warmup) {
+      ASSERT_LE(number_of_allocations, static_cast<size_t>(8));
+      ASSERT_EQ(matches.size(), identifier_image);
+    }
+  }
+  ASSERT_EQ(database.size(), number_of_images);
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST(HBST, SteadyStateMatchAndAddWithMatches) {
+  // ds keep all descriptors in the root leaf - structural growth is not part of the test
+  Tree::Configuration configuration;
+  configuration.maximum_leaf_size = std::numeric_limits<uint64_t>::max();
+  std::mt19937 random_number_generator(0);
+  const size_t number_of_images               = 50;
+  const size_t number_of_images_warmup        = 5;
+  const size_t number_of_matchables_per_image = 200;
+
+  // ds landmarks observed in every image
+  std::vector<Tree::Descriptor> descriptors;
+  for (const Tree::Matchable* matchable :
+       generateMatchables(random_number_generator, number_of_matchables_per_image, 0)) {
+    descriptors.push_back(matchable->descriptor);
+    delete matchable;
+  }
+
+  // ds stream images through the database, reusing the same sparse output
+  Tree database(configuration);
+  Tree::MatchBuffer matches;
+  size_t number_of_allocations_total = 0;
+  for (uint64_t identifier_image = 0; identifier_image < number_of_images; ++identifier_image) {
+    const Tree::MatchableVector matchables =
+      observeMatchables(random_number_generator, descriptors, identifier_image);
+    number_of_allocations = 0;
+    counting_allocations  = true;
+    database.matchAndAdd(matchables, matches);
+    counting_allocations = false;
+
+    // ds every landmark is matched in every previous image - match records do not allocate
+    // the number of allocations may only grow with the amortized growth of reused storage
+    if (identifier_image >= number_of_images_warmup) {
+      ASSERT_EQ(matches.size(), identifier_image);
+      ASSERT_EQ(matches.matches.size(), identifier_image * number_of_matchables_per_image);
+      number_of_allocations_total += number_of_allocations;
+    }
+  }
+  ASSERT_LE(number_of_allocations_total, 2 * (number_of_images - number_of_images_warmup));
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST(HBST, SteadyStateMatchAndAddSplitTree) {
+  // ds default node parameters: the tree descends and keeps splitting leafs while streaming
+  Tree::Configuration configuration;
+  std::mt19937 random_number_generator(0);
+  const size_t number_of_images               = 100;
+  const size_t number_of_images_warmup        = 20;
+  const size_t number_of_matchables_per_image = 200;
+
+  // ds stream images through the database, reusing the same output map
+  Tree database(configuration);
+  Tree::MatchVectorMap matches;
+  size_t number_of_allocations_total = 0;
+  size_t number_of_splits_total      = 0;
+  for (uint64_t identifier_image = 0; identifier_image < number_of_images; ++identifier_image) {
+    const Tree::MatchableVector matchables =
+      generateMatchables(random_number_generator, number_of_matchables_per_image, identifier_image);
+    const size_t number_of_splits = getNumberOfSplits(database.root());
+    number_of_allocations         = 0;
+    counting_allocations          = true;
+    database.matchAndAdd(matchables, matches);
+    counting_allocations = false;
+    if (identifier_image >= number_of_images_warmup) {
+      ASSERT_GT(number_of_splits, static_cast<size_t>(1));
+      ASSERT_EQ(matches.size(), identifier_image);
+      number_of_allocations_total += number_of_allocations;
+      number_of_splits_total += getNumberOfSplits(database.root()) - number_of_splits;
+    }
+  }
+  ASSERT_EQ(database.size(), number_of_images);
+  ASSERT_GT(number_of_splits_total, static_cast<size_t>(0));
+
+  // ds descent and matching never allocate: beyond the bookkeeping of each image only splits
+  // allocate - two nodes with leaf storage whose vectors grow at most log2(leaf size) times
+  ASSERT_LE(number_of_allocations_total,
+            8 * (number_of_images - number_of_images_warmup) + 40 * number_of_splits_total);
+
+  // ds clear database
+  database.clear(true);
+}
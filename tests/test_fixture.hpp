@@ -9,8 +9,8 @@ typedef srrg_hbst::BinaryTree256<size_t> Tree;
 class HBST : public ::testing::Test {
 protected:
   void SetUp() override {
-    Tree::Node::maximum_partitioning = 0.45;            // ds noisy, synthetic case
-    random_number_generator          = std::mt19937(0); // ds locked seed for reproducibility
+    configuration.maximum_partitioning = 0.45;            // ds noisy, synthetic case
+    random_number_generator            = std::mt19937(0); // ds locked seed for reproducibility
     generateMatchables(matchables_train_per_image, number_of_images_train, 0);
     generateMatchables(matchables_query_per_image, number_of_images_query, number_of_images_train);
   }
@@ -63,6 +63,9 @@ protected:
   std::vector<Tree::MatchableVector> matchables_query_per_image;
   std::vector<Tree::MatchableVector> matchables_train_per_image;
 
+  //! configuration of the trees built in the tests
+  Tree::Configuration configuration;
+
   //! configuration
   static constexpr size_t number_of_images_query         = 1;
   static constexpr size_t number_of_images_train         = 10;
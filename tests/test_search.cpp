@@ -1,5 +1,10 @@
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
 
+#include "srrg_hbst/utilities/binary_tree_tuner.hpp"
 #include "test_fixture.hpp"
 
 using namespace srrg_hbst;
@@ -11,7 +16,7 @@ int main(int argc_, char** argv_) {
 
 TEST_F(HBST, SearchIdentical) {
   // ds populate the database
-  Tree database;
+  Tree database(configuration);
   for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
     database.add(matchables_train, SplittingStrategy::SplitEven);
   }
@@ -25,7 +30,7 @@ TEST_F(HBST, SearchIdentical) {
     ASSERT_EQ(matches.size(), static_cast<size_t>(10));
     ASSERT_EQ(matches[i].size(), matchables_query.size());
     for (size_t j = 0; j < matches[i].size(); ++j) {
-      ASSERT_EQ(matches[i][j].distance, 0);
+      ASSERT_EQ(matches[i][j].distance, 0u);
     }
   }
 
@@ -38,7 +43,7 @@ TEST_F(HBST, SearchNoisy) {
   number_of_bits_to_flip = 10;
 
   // ds populate the database
-  Tree database;
+  Tree database(configuration);
   for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
     database.add(matchables_train, SplittingStrategy::SplitEven);
   }
@@ -79,10 +84,10 @@ TEST_F(HBST, SearchNoisy) {
     size_t number_of_correct_matches = 0;
     for (size_t j = 0; j < matches[i].size(); ++j) {
       Tree::Match& match(matches[i][j]);
-      ASSERT_LT(match.distance, 10);
+      ASSERT_LT(match.distance, 10u);
 
       // ds indices match by construction
-      if (match.object_query == match.object_references.front()) {
+      if (match.object_query == match.object_reference) {
         ++number_of_correct_matches;
       }
     }
@@ -93,3 +98,1567 @@ TEST_F(HBST, SearchNoisy) {
   database.clear(true);
   ASSERT_EQ(database.size(), static_cast<size_t>(0));
 }
+
+TEST_F(HBST, TopKImages) {
+  // ds populate the database
+  Tree database(configuration);
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+  ASSERT_EQ(database.size(), static_cast<size_t>(10));
+
+  // ds the top K images must correspond to the best scores over all images
+  const Tree::MatchableVector& matchables_query = matchables_train_per_image[3];
+  const Tree::ScoreVector scores = database.getScorePerImage(matchables_query, true);
+  const Tree::ScoreVector scores_top = database.getTopKImages(matchables_query, 3);
+  ASSERT_EQ(scores_top.size(), static_cast<size_t>(3));
+  ASSERT_EQ(scores_top[0].identifier_reference, static_cast<size_t>(3));
+  ASSERT_EQ(scores_top[0].number_of_matches, matchables_query.size());
+  for (size_t i = 0; i < scores_top.size(); ++i) {
+    ASSERT_EQ(scores_top[i].number_of_matches, scores[i].number_of_matches);
+  }
+
+  // ds parallel accumulation must not change the result
+  const Tree::ScoreVector scores_top_parallel = database.getTopKImages(matchables_query, 3, 25, 4);
+  ASSERT_EQ(scores_top_parallel.size(), scores_top.size());
+  for (size_t i = 0; i < scores_top.size(); ++i) {
+    ASSERT_EQ(scores_top_parallel[i].identifier_reference, scores_top[i].identifier_reference);
+    ASSERT_EQ(scores_top_parallel[i].number_of_matches, scores_top[i].number_of_matches);
+  }
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST_F(HBST, SearchBatch) {
+  // ds populate the database
+  Tree database(configuration);
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+
+  // ds leaf-major batch matching must reproduce the per-query results
+  const Tree::MatchableVector& matchables_query = matchables_query_per_image[0];
+  Tree::MatchVector matches, matches_batch, matches_lazy, matches_lazy_batch;
+  database.match(matchables_query, matches);
+  database.matchBatch(matchables_query, matches_batch);
+  database.matchLazy(matchables_query, matches_lazy);
+  database.matchLazyBatch(matchables_query, matches_lazy_batch);
+  ASSERT_GT(matches.size(), static_cast<size_t>(0));
+  ASSERT_EQ(matches_batch.size(), matches.size());
+  for (size_t i = 0; i < matches.size(); ++i) {
+    ASSERT_EQ(matches_batch[i].matchable_query, matches[i].matchable_query);
+    ASSERT_EQ(matches_batch[i].matchable_reference, matches[i].matchable_reference);
+    ASSERT_EQ(matches_batch[i].distance, matches[i].distance);
+  }
+  ASSERT_EQ(matches_lazy_batch.size(), matches_lazy.size());
+  for (size_t i = 0; i < matches_lazy.size(); ++i) {
+    ASSERT_EQ(matches_lazy_batch[i].matchable_query, matches_lazy[i].matchable_query);
+    ASSERT_EQ(matches_lazy_batch[i].matchable_reference, matches_lazy[i].matchable_reference);
+  }
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST_F(HBST, MatchTies) {
+  // ds two references in the first image at the same distance to a query, in the second image a
+  // tie that is replaced by a closer reference
+  const Tree::Matchable* matchable_query = matchables_query_per_image[0][0];
+  std::vector<Tree::Descriptor> descriptors(5, matchable_query->descriptor);
+  descriptors[0].flip(0);
+  descriptors[1].flip(1);
+  descriptors[2].flip(0).flip(1);
+  descriptors[3].flip(2).flip(3);
+  descriptors[4].flip(4);
+  Tree::MatchableVector matchables_reference;
+  matchables_reference.push_back(new Tree::Matchable(1, descriptors[0], 0));
+  matchables_reference.push_back(new Tree::Matchable(2, descriptors[1], 0));
+  matchables_reference.push_back(new Tree::Matchable(3, descriptors[2], 1));
+  matchables_reference.push_back(new Tree::Matchable(4, descriptors[3], 1));
+  matchables_reference.push_back(new Tree::Matchable(5, descriptors[4], 1));
+  configuration.maximum_number_of_matchables_linear_search = 0;
+  Tree database(configuration);
+  const Tree::MatchableVector::iterator it_second_image = matchables_reference.begin() + 2;
+  database.add(Tree::MatchableVector(matchables_reference.begin(), it_second_image),
+               SplittingStrategy::SplitEven);
+  database.add(Tree::MatchableVector(it_second_image, matchables_reference.end()),
+               SplittingStrategy::SplitEven);
+
+  // ds the first reference is stored in the match, the tie is counted
+  Tree::MatchVectorMap match_vectors;
+  database.match(Tree::MatchableVector(1, matchables_query_per_image[0][0]), match_vectors);
+  ASSERT_EQ(match_vectors.at(0).size(), static_cast<size_t>(1));
+  const Tree::Match& match = match_vectors.at(0)[0];
+  ASSERT_EQ(match.distance, static_cast<uint32_t>(1));
+  ASSERT_EQ(match.number_of_references, static_cast<uint32_t>(2));
+  ASSERT_EQ(match.matchable_reference, matchables_reference[0]);
+  ASSERT_EQ(match.object_reference, static_cast<uint64_t>(1));
+
+  // ds the sparse output keeps the tied references in its side table
+  Tree::MatchBuffer matches;
+  database.match(Tree::MatchableVector(1, matchables_query_per_image[0][0]), matches);
+  ASSERT_EQ(matches.size(), static_cast<size_t>(2));
+  const Tree::Match& match_tied = *matches.begin(0);
+  ASSERT_EQ(match_tied.number_of_references, static_cast<uint32_t>(2));
+  ASSERT_EQ(matches.endReferences(match_tied) - matches.beginReferences(match_tied), 1);
+  ASSERT_EQ(matches.beginReferences(match_tied)->matchable_reference, matchables_reference[1]);
+  ASSERT_EQ(matches.beginReferences(match_tied)->object_reference, static_cast<uint64_t>(2));
+  const Tree::Match& match_replaced = *matches.begin(1);
+  ASSERT_EQ(match_replaced.distance, static_cast<uint32_t>(1));
+  ASSERT_EQ(match_replaced.number_of_references, static_cast<uint32_t>(1));
+  ASSERT_EQ(match_replaced.matchable_reference, matchables_reference[4]);
+  ASSERT_EQ(matches.beginReferences(match_replaced), matches.endReferences(match_replaced));
+  ASSERT_EQ(matches.references.size(), static_cast<size_t>(1));
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST_F(HBST, DistanceBounded) {
+  const Tree::MatchableVector& matchables_a = matchables_train_per_image[0];
+  const Tree::MatchableVector& matchables_b = matchables_train_per_image[1];
+  for (size_t i = 0; i < matchables_a.size(); ++i) {
+    const uint32_t distance = matchables_a[i]->distance(matchables_b[i]);
+    for (const uint32_t bound : {0u, 10u, 25u, 256u}) {
+      const uint32_t distance_bounded = matchables_a[i]->distanceBounded(matchables_b[i], bound);
+      if (distance <= bound) {
+        ASSERT_EQ(distance_bounded, distance);
+      } else {
+        ASSERT_GT(distance_bounded, bound);
+        ASSERT_LE(distance_bounded, distance);
+      }
+    }
+  }
+
+  // ds word-wise access must agree with the bitset interface, also for descriptor sizes that are
+  // not a multiple of 64 bits (the fast path is taken for the standard libraries we know)
+  using Matchable486 = BinaryMatchable<size_t, 486>;
+  ASSERT_TRUE(Tree::Matchable::is_word_layout);
+  ASSERT_TRUE(Matchable486::is_word_layout);
+  std::uniform_int_distribution<uint32_t> bit_distribution(0, 1);
+  for (size_t i = 0; i < 100; ++i) {
+    Matchable486::Descriptor descriptor_a;
+    Matchable486::Descriptor descriptor_b;
+    uint64_t sketch = 0;
+    for (uint32_t index_bit = 0; index_bit < Matchable486::descriptor_size_bits; ++index_bit) {
+      descriptor_a[index_bit] = bit_distribution(random_number_generator);
+      descriptor_b[index_bit] = bit_distribution(random_number_generator);
+      sketch ^= static_cast<uint64_t>(descriptor_a[index_bit]) << (index_bit % 64);
+    }
+    const uint32_t distance = (descriptor_a ^ descriptor_b).count();
+    ASSERT_EQ(Matchable486::distanceBounded(descriptor_a, descriptor_b, 486), distance);
+    ASSERT_GT(Matchable486::distanceBounded(descriptor_a, descriptor_b, distance - 1),
+              distance - 1);
+    ASSERT_EQ(Matchable486::getSketch(descriptor_a), sketch);
+  }
+
+  // ds training matchables are owned by the tree in the other tests
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    for (const Tree::Matchable* matchable : matchables_train) {
+      delete matchable;
+    }
+  }
+}
+
+// ds per-bit reference conversion of a raw descriptor: bit v of byte b is descriptor bit 8*b+v,
+// overflowing bits are taken from the most significant bits of the last byte
+template <typename MatchableType_>
+typename MatchableType_::Descriptor getDescriptorPerBit(const uint8_t* descriptor_raw_) {
+  typename MatchableType_::Descriptor descriptor;
+  for (uint32_t index_bit = 0; index_bit < MatchableType_::descriptor_size_bits_in_bytes;
+       ++index_bit) {
+    descriptor[index_bit] = (descriptor_raw_[index_bit / 8] >> (index_bit % 8)) & 1;
+  }
+  for (uint32_t v = 0; v < MatchableType_::descriptor_size_bits_overflow; ++v) {
+    descriptor[MatchableType_::descriptor_size_bits_in_bytes + v] =
+      (descriptor_raw_[MatchableType_::raw_descriptor_size_bytes] >>
+       (8 - MatchableType_::descriptor_size_bits_overflow + v)) &
+      1;
+  }
+  return descriptor;
+}
+
+TEST_F(HBST, RawDescriptors) {
+  // ds known descriptor buffer with padded rows (the padding must be ignored)
+  const size_t number_of_descriptors = 3;
+  const size_t stride_bytes          = Tree::Matchable::raw_descriptor_size_bytes + 8;
+  std::vector<uint8_t> descriptors_raw(number_of_descriptors * stride_bytes, 0xFF);
+  for (size_t index_descriptor = 0; index_descriptor < number_of_descriptors; ++index_descriptor) {
+    for (size_t index_byte = 0; index_byte < Tree::Matchable::raw_descriptor_size_bytes;
+         ++index_byte) {
+      descriptors_raw[index_descriptor * stride_bytes + index_byte] =
+        static_cast<uint8_t>(37 * index_byte + 11 * index_descriptor + 1);
+    }
+  }
+
+  // ds the raw buffer ingestion must reproduce the per-bit conversion
+  const std::vector<size_t> objects = {4, 5, 6};
+  const Tree::MatchableVector matchables =
+    Tree::getMatchables(descriptors_raw.data(), number_of_descriptors, stride_bytes, objects, 7);
+  ASSERT_EQ(matchables.size(), number_of_descriptors);
+  for (size_t index_descriptor = 0; index_descriptor < number_of_descriptors; ++index_descriptor) {
+    const uint8_t* descriptor_raw = descriptors_raw.data() + index_descriptor * stride_bytes;
+    ASSERT_EQ(matchables[index_descriptor]->descriptor,
+              getDescriptorPerBit<Tree::Matchable>(descriptor_raw));
+    ASSERT_EQ(matchables[index_descriptor]->objects.size(), static_cast<size_t>(1));
+    ASSERT_EQ(matchables[index_descriptor]->objects.begin()->first, static_cast<uint64_t>(7));
+    ASSERT_EQ(matchables[index_descriptor]->objects.begin()->second, objects[index_descriptor]);
+    delete matchables[index_descriptor];
+  }
+
+  // ds descriptor sizes that are neither a multiple of 64 nor of 8 bits (overflowing bits)
+  using Matchable486 = BinaryMatchable<size_t, 486>;
+  using Matchable100 = BinaryMatchable<size_t, 100>;
+  ASSERT_EQ(Matchable486::descriptor_size_bits_overflow, static_cast<uint32_t>(6));
+  ASSERT_EQ(Matchable100::descriptor_size_bits_overflow, static_cast<uint32_t>(4));
+  std::vector<uint8_t> descriptor_raw(Matchable486::raw_descriptor_size_bytes + 1);
+  for (size_t index_byte = 0; index_byte < descriptor_raw.size(); ++index_byte) {
+    descriptor_raw[index_byte] = static_cast<uint8_t>(53 * index_byte + 200);
+  }
+  ASSERT_EQ(Matchable486::getDescriptor(descriptor_raw.data()),
+            getDescriptorPerBit<Matchable486>(descriptor_raw.data()));
+  ASSERT_EQ(Matchable100::getDescriptor(descriptor_raw.data()),
+            getDescriptorPerBit<Matchable100>(descriptor_raw.data()));
+
+  // ds bits beyond the descriptor are never set
+  const Matchable100::Descriptor descriptor_100 =
+    Matchable100::getDescriptor(descriptor_raw.data());
+  ASSERT_EQ(Matchable100::distanceBounded(descriptor_100, Matchable100::Descriptor(), 100),
+            static_cast<uint32_t>(descriptor_100.count()));
+
+  // ds training matchables are owned by the tree in the other tests
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    for (const Tree::Matchable* matchable : matchables_train) {
+      delete matchable;
+    }
+  }
+}
+
+TEST_F(HBST, SearchDescriptorQueries) {
+  // ds populate the database
+  Tree database(configuration);
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+
+  // ds plain descriptors and objects of the first query image (no matchable allocation)
+  const Tree::MatchableVector& matchables_query = matchables_query_per_image[0];
+  std::vector<Tree::Descriptor> descriptors_query;
+  std::vector<size_t> objects_query;
+  for (const Tree::Matchable* matchable_query : matchables_query) {
+    descriptors_query.push_back(matchable_query->descriptor);
+    objects_query.push_back(matchable_query->objects.begin()->second);
+  }
+  const Tree::DescriptorQueries queries(descriptors_query, objects_query);
+
+  // ds descriptor queries must reproduce the matchable query results
+  Tree::MatchVector matches, matches_view;
+  database.match(matchables_query, matches);
+  database.match(queries, matches_view);
+  ASSERT_GT(matches.size(), static_cast<size_t>(0));
+  ASSERT_EQ(matches_view.size(), matches.size());
+  for (size_t i = 0; i < matches.size(); ++i) {
+    ASSERT_EQ(matches_view[i].matchable_query, nullptr);
+    ASSERT_EQ(matches_view[i].object_query, matches[i].object_query);
+    ASSERT_EQ(matches_view[i].matchable_reference, matches[i].matchable_reference);
+    ASSERT_EQ(matches_view[i].distance, matches[i].distance);
+  }
+  ASSERT_EQ(database.getNumberOfMatches(queries), database.getNumberOfMatches(matchables_query));
+  const Tree::ScoreVector scores      = database.getScorePerImage(matchables_query);
+  const Tree::ScoreVector scores_view  = database.getScorePerImage(queries);
+  ASSERT_EQ(scores_view.size(), scores.size());
+  for (size_t i = 0; i < scores.size(); ++i) {
+    ASSERT_EQ(scores_view[i].number_of_matches, scores[i].number_of_matches);
+  }
+  Tree::MatchVectorMap matches_per_image, matches_per_image_view;
+  database.match(matchables_query, matches_per_image);
+  database.match(queries, matches_per_image_view);
+  for (const Tree::MatchVectorMap::value_type& matches_image : matches_per_image) {
+    ASSERT_EQ(matches_per_image_view.at(matches_image.first).size(), matches_image.second.size());
+  }
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST_F(HBST, SearchMatchBuffer) {
+  // ds populate the database
+  Tree database(configuration);
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+
+  // ds sparse output must contain exactly the non-empty per-image match vectors
+  for (const Tree::MatchableVector& matchables_query : matchables_query_per_image) {
+    Tree::MatchVectorMap matches_per_image;
+    Tree::MatchBuffer matches_buffer;
+    database.match(matchables_query, matches_per_image);
+    database.match(matchables_query, matches_buffer);
+    size_t number_of_images_matched = 0;
+    for (const Tree::MatchVectorMap::value_type& matches_image : matches_per_image) {
+      if (!matches_image.second.empty()) {
+        ++number_of_images_matched;
+      }
+    }
+    ASSERT_EQ(matches_buffer.size(), number_of_images_matched);
+    ASSERT_EQ(matches_buffer.offsets.size(), matches_buffer.size() + 1);
+    for (size_t index_image = 0; index_image < matches_buffer.size(); ++index_image) {
+      if (index_image > 0) {
+        ASSERT_LT(matches_buffer.identifiers[index_image - 1],
+                  matches_buffer.identifiers[index_image]);
+      }
+      const Tree::MatchVector& matches =
+        matches_per_image.at(matches_buffer.identifiers[index_image]);
+      ASSERT_EQ(matches_buffer.numberOfMatches(index_image), matches.size());
+      const Tree::Match* match_buffer = matches_buffer.begin(index_image);
+      for (const Tree::Match& match : matches) {
+        ASSERT_EQ(match_buffer->object_query, match.object_query);
+        ASSERT_EQ(match_buffer->object_reference, match.object_reference);
+        ASSERT_EQ(match_buffer->distance, match.distance);
+        ++match_buffer;
+      }
+      ASSERT_EQ(match_buffer, matches_buffer.end(index_image));
+    }
+  }
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST_F(HBST, SearchVisitor) {
+  // ds populate the database
+  Tree database(configuration);
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+
+  // ds streamed matches must be identical to the materialized ones
+  const Tree::MatchableVector& matchables_query = matchables_query_per_image[0];
+  Tree::MatchVector matches, matches_lazy;
+  database.match(matchables_query, matches);
+  database.matchLazy(matchables_query, matches_lazy);
+  size_t index_match = 0;
+  database.match(matchables_query,
+                 25,
+                 [&](const size_t& index_query_,
+                     const Tree::Matchable* matchable_reference_,
+                     const uint32_t& distance_) {
+                   ASSERT_LT(index_match, matches.size());
+                   ASSERT_EQ(matchables_query[index_query_], matches[index_match].matchable_query);
+                   ASSERT_EQ(matchable_reference_, matches[index_match].matchable_reference);
+                   ASSERT_EQ(distance_, matches[index_match].distance);
+                   ++index_match;
+                 });
+  ASSERT_EQ(index_match, matches.size());
+  index_match = 0;
+  database.matchLazy(matchables_query,
+                     25,
+                     [&](const size_t& index_query_,
+                         const Tree::Matchable* matchable_reference_,
+                         const uint32_t& /*distance_*/) {
+                       ASSERT_LT(index_match, matches_lazy.size());
+                       ASSERT_EQ(matchable_reference_,
+                                 matches_lazy[index_match].matchable_reference);
+                       ++index_match;
+                     });
+  ASSERT_EQ(index_match, matches_lazy.size());
+
+  // ds image voting without intermediate match storage
+  Tree::MatchVectorMap matches_per_image;
+  database.match(matchables_query, matches_per_image);
+  std::map<uint64_t, size_t> number_of_matches_per_image;
+  database.matchPerImage(
+    matchables_query,
+    25,
+    [&](const uint64_t& identifier_reference_, const Tree::Match& /*match_*/) {
+      ++number_of_matches_per_image[identifier_reference_];
+    });
+  for (const Tree::MatchVectorMap::value_type& matches_image : matches_per_image) {
+    ASSERT_EQ(number_of_matches_per_image[matches_image.first], matches_image.second.size());
+  }
+
+  // ds clear database
+  database.clear(true);
+}
+
+// ds destination leaf of a descriptor by regular per-query descent
+const Tree::Node* getLeaf(const Tree::Node* node_, const Tree::Descriptor& descriptor_) {
+  while (node_->hasLeafs()) {
+    node_ = descriptor_[node_->indexSplitBit()] ? node_->right : node_->left;
+  }
+  return node_;
+}
+
+TEST_F(HBST, SearchLockstep) {
+  // ds populate the database - leafs at different depths, every leaf scanned completely
+  configuration.sketch_distance_ratio                      = 0;
+  configuration.maximum_number_of_matchables_linear_search = 0;
+  Tree database(configuration);
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+
+  // ds queries descended in interleaved groups must end in the leafs of a per-query descent: the
+  // streamed best reference of every query is the best reference of its own leaf
+  const Tree::MatchableVector& matchables_query = matchables_query_per_image[0];
+  const uint32_t maximum_distance               = Tree::Matchable::descriptor_size_bits + 1;
+  size_t number_of_visited_queries              = 0;
+  database.match(matchables_query,
+                 maximum_distance,
+                 [&](const size_t& index_query_,
+                     const Tree::Matchable* matchable_reference_,
+                     const uint32_t& distance_) {
+                   const Tree::Descriptor& descriptor_query =
+                     matchables_query[index_query_]->descriptor;
+                   const Tree::Node* leaf = getLeaf(database.root(), descriptor_query);
+                   uint32_t distance_best = maximum_distance;
+                   for (const Tree::Matchable* matchable_reference : leaf->getMatchables()) {
+                     distance_best = std::min(
+                       distance_best,
+                       static_cast<uint32_t>(
+                         (matchable_reference->descriptor ^ descriptor_query).count()));
+                   }
+                   ASSERT_NE(std::find(leaf->getMatchables().begin(),
+                                       leaf->getMatchables().end(),
+                                       matchable_reference_),
+                             leaf->getMatchables().end());
+                   ASSERT_EQ(distance_, distance_best);
+                   ++number_of_visited_queries;
+                 });
+  ASSERT_EQ(number_of_visited_queries, matchables_query.size());
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST_F(HBST, SearchTracked) {
+  number_of_bits_to_flip = 5;
+
+  // ds populate the database
+  Tree database(configuration);
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+
+  // ds landmarks tracked over consecutive frames (track identifier: landmark index)
+  const Tree::MatchableVector& landmarks = matchables_train_per_image[0];
+  std::vector<uint64_t> identifiers_track(landmarks.size());
+  for (size_t index_track = 0; index_track < landmarks.size(); ++index_track) {
+    identifiers_track[index_track] = index_track;
+  }
+  Tree::TrackCache track_cache;
+  for (uint64_t identifier_frame = 0; identifier_frame < 5; ++identifier_frame) {
+    freeMatchablesQuery();
+    Tree::MatchableVector matchables_query;
+    for (size_t index_track = 0; index_track < landmarks.size(); ++index_track) {
+      Tree::Descriptor descriptor = landmarks[index_track]->descriptor;
+      flipBits(descriptor);
+      matchables_query.emplace_back(new Tree::Matchable(index_track, descriptor, 100));
+    }
+    matchables_query_per_image.push_back(matchables_query);
+
+    // ds tracked matches must be identical to the untracked ones
+    Tree::MatchVector matches, matches_tracked;
+    database.match(matchables_query, matches);
+    database.match(matchables_query, identifiers_track, track_cache, matches_tracked);
+    ASSERT_EQ(matches_tracked.size(), matches.size());
+    for (size_t index_match = 0; index_match < matches.size(); ++index_match) {
+      ASSERT_EQ(matches_tracked[index_match].matchable_query, matches[index_match].matchable_query);
+      ASSERT_EQ(matches_tracked[index_match].matchable_reference,
+                matches[index_match].matchable_reference);
+      ASSERT_EQ(matches_tracked[index_match].distance, matches[index_match].distance);
+    }
+    ASSERT_EQ(track_cache.tracks.size(), landmarks.size());
+  }
+
+  // ds insert tracked observations - cached leafs are split along the way
+  for (uint64_t identifier_frame = 0; identifier_frame < 5; ++identifier_frame) {
+    Tree::MatchableVector matchables_query;
+    for (size_t index_track = 0; index_track < landmarks.size(); ++index_track) {
+      Tree::Descriptor descriptor = landmarks[index_track]->descriptor;
+      flipBits(descriptor);
+      matchables_query.emplace_back(
+        new Tree::Matchable(index_track, descriptor, 100 + identifier_frame));
+    }
+    Tree::MatchBuffer matches, matches_tracked;
+    database.match(matchables_query, matches);
+    database.matchAndAdd(matchables_query, identifiers_track, track_cache, matches_tracked);
+    ASSERT_EQ(matches_tracked.identifiers, matches.identifiers);
+    ASSERT_EQ(matches_tracked.offsets, matches.offsets);
+    for (size_t index_match = 0; index_match < matches.matches.size(); ++index_match) {
+      ASSERT_EQ(matches_tracked.matches[index_match].matchable_reference,
+                matches.matches[index_match].matchable_reference);
+    }
+  }
+
+  // ds the cache is flushed once the tree is cleared
+  database.clear(true);
+  Tree::MatchVector matches_tracked;
+  database.match(matchables_query_per_image[0], identifiers_track, track_cache, matches_tracked);
+  ASSERT_TRUE(matches_tracked.empty());
+  ASSERT_TRUE(track_cache.tracks.empty());
+}
+
+TEST_F(HBST, AddConcurrent) {
+  // ds insert all images from multiple threads into the same database (parent summaries are
+  // updated under their own locks)
+  configuration.summarize_internal_nodes = true;
+  Tree database(configuration);
+  const size_t number_of_threads = 4;
+  std::vector<std::thread> workers;
+  for (size_t index_thread = 0; index_thread < number_of_threads; ++index_thread) {
+    workers.emplace_back([&, index_thread]() {
+      for (size_t index_image = index_thread; index_image < matchables_train_per_image.size();
+           index_image += number_of_threads) {
+        database.addConcurrent(matchables_train_per_image[index_image]);
+      }
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  ASSERT_EQ(database.size(), static_cast<size_t>(10));
+  ASSERT_EQ(database.numberOfMatchablesCompressed(), 10 * number_of_matchables_per_image);
+
+  // ds every inserted descriptor must be found again
+  freeMatchablesQuery();
+  for (const Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    Tree::MatchableVector matchables_query;
+    for (const Tree::Matchable* matchable_train : matchables_train) {
+      matchables_query.emplace_back(
+        new Tree::Matchable(matchable_train->objects.begin()->second,
+                            matchable_train->descriptor,
+                            matchables_query_per_image.size() + 10));
+    }
+    Tree::MatchVector matches;
+    database.match(matchables_query, matches, 1);
+    ASSERT_EQ(matches.size(), number_of_matchables_per_image);
+    matchables_query_per_image.push_back(matchables_query);
+  }
+
+  // ds concurrent matching and insertion of the identical descriptors of two images
+  Tree::MatchBuffer matches_first, matches_second;
+  std::thread worker_first([&]() {
+    database.matchAndAddConcurrent(matchables_query_per_image[0], matches_first, 1);
+  });
+  std::thread worker_second([&]() {
+    database.matchAndAddConcurrent(matchables_query_per_image[1], matches_second, 1);
+  });
+  worker_first.join();
+  worker_second.join();
+  ASSERT_GE(matches_first.size(), static_cast<size_t>(1));
+  ASSERT_EQ(matches_first.identifiers[0], static_cast<uint64_t>(0));
+  ASSERT_EQ(matches_first.numberOfMatches(0), number_of_matchables_per_image);
+  ASSERT_EQ(matches_second.identifiers[0], static_cast<uint64_t>(1));
+  ASSERT_EQ(matches_second.numberOfMatches(0), number_of_matchables_per_image);
+  ASSERT_EQ(database.size(), static_cast<size_t>(12));
+  matchables_query_per_image.erase(matchables_query_per_image.begin(),
+                                   matchables_query_per_image.begin() + 2);
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST_F(HBST, SplitBudget) {
+  // ds split at most a single leaf per insertion call - the budget is per tree, a second tree in
+  // the same process keeps splitting without limit
+  Tree::Configuration configuration_unlimited = configuration;
+  configuration.maximum_number_of_splits_per_call = 1;
+  Tree database(configuration);
+  Tree database_unlimited(configuration_unlimited);
+  size_t number_of_leafs_pending_maximum = 0;
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    Tree::MatchableVector matchables_unlimited;
+    for (const Tree::Matchable* matchable_train : matchables_train) {
+      matchables_unlimited.emplace_back(new Tree::Matchable(
+        matchable_train->objects.begin()->second,
+        matchable_train->descriptor,
+        matchable_train->objects.begin()->first));
+    }
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+    database_unlimited.add(matchables_unlimited, SplittingStrategy::SplitEven);
+    number_of_leafs_pending_maximum =
+      std::max(number_of_leafs_pending_maximum, database.numberOfPendingLeafs());
+    ASSERT_EQ(database_unlimited.numberOfPendingLeafs(), static_cast<size_t>(0));
+  }
+  ASSERT_GT(number_of_leafs_pending_maximum, static_cast<size_t>(0));
+  database_unlimited.clear(true);
+
+  // ds oversized leafs remain queryable - every inserted descriptor must be found
+  freeMatchablesQuery();
+  Tree::MatchableVector matchables_query;
+  for (const Tree::Matchable* matchable_train : matchables_train_per_image.back()) {
+    matchables_query.emplace_back(new Tree::Matchable(
+      matchable_train->objects.begin()->second, matchable_train->descriptor, 10));
+  }
+  matchables_query_per_image.push_back(matchables_query);
+  Tree::MatchVector matches;
+  database.match(matchables_query, matches, 1);
+  ASSERT_EQ(matches.size(), number_of_matchables_per_image);
+
+  // ds complete all pending splits
+  ASSERT_EQ(database.splitPendingLeafs(), static_cast<size_t>(0));
+  ASSERT_EQ(database.numberOfPendingLeafs(), static_cast<size_t>(0));
+  matches.clear();
+  database.match(matchables_query, matches, 1);
+  ASSERT_EQ(matches.size(), number_of_matchables_per_image);
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST_F(HBST, MatchAndAddAsync) {
+  number_of_bits_to_flip = 5;
+
+  // ds stream noisy observations of the same landmarks into two databases - each frame has to see
+  // all previous frames, also without leaf splits (single leaf, insertion only)
+  const Tree::MatchableVector& landmarks = matchables_train_per_image[0];
+  for (const SplittingStrategy& train_mode :
+       {SplittingStrategy::SplitEven, SplittingStrategy::DoNothing}) {
+    configuration.maximum_leaf_size =
+      (train_mode == SplittingStrategy::DoNothing) ? 100000 : Tree::Node::maximum_leaf_size;
+    Tree database(configuration), database_async(configuration);
+    for (uint64_t identifier_frame = 0; identifier_frame < 10; ++identifier_frame) {
+      Tree::MatchableVector matchables, matchables_async;
+      for (size_t index_landmark = 0; index_landmark < landmarks.size(); ++index_landmark) {
+        Tree::Descriptor descriptor = landmarks[index_landmark]->descriptor;
+        flipBits(descriptor);
+        matchables.emplace_back(new Tree::Matchable(index_landmark, descriptor, identifier_frame));
+        matchables_async.emplace_back(
+          new Tree::Matchable(index_landmark, descriptor, identifier_frame));
+      }
+
+      // ds asynchronous matches must be identical to the blocking ones
+      Tree::MatchBuffer matches, matches_async;
+      database.matchAndAdd(matchables, matches, 25, train_mode);
+      database_async.matchAndAddAsync(matchables_async, matches_async, 25, train_mode);
+      ASSERT_EQ(matches_async.identifiers.size(), identifier_frame);
+      ASSERT_EQ(matches_async.identifiers, matches.identifiers);
+      ASSERT_EQ(matches_async.offsets, matches.offsets);
+      for (size_t index_match = 0; index_match < matches.matches.size(); ++index_match) {
+        ASSERT_EQ(matches_async.matches[index_match].object_query,
+                  matches.matches[index_match].object_query);
+        ASSERT_EQ(matches_async.matches[index_match].object_reference,
+                  matches.matches[index_match].object_reference);
+        ASSERT_EQ(matches_async.matches[index_match].distance,
+                  matches.matches[index_match].distance);
+      }
+
+      // ds queries wait for the pending insertion by default
+      const Tree::ScoreVector scores = database.getScorePerImage(landmarks);
+      const Tree::ScoreVector scores_async = database_async.getScorePerImage(landmarks);
+      ASSERT_EQ(scores_async.size(), scores.size());
+      for (size_t index_score = 0; index_score < scores.size(); ++index_score) {
+        ASSERT_EQ(scores_async[index_score].identifier_reference,
+                  scores[index_score].identifier_reference);
+        ASSERT_EQ(scores_async[index_score].number_of_matches,
+                  scores[index_score].number_of_matches);
+      }
+    }
+    database_async.synchronize();
+    ASSERT_EQ(database_async.size(), database.size());
+    ASSERT_EQ(database_async.numberOfMatchablesUncompressed(),
+              database.numberOfMatchablesUncompressed());
+    ASSERT_EQ(database_async.numberOfMatchablesCompressed(),
+              database.numberOfMatchablesCompressed());
+    ASSERT_EQ(database_async.trainedIdentifiers(), database.trainedIdentifiers());
+
+    // ds clear databases
+    database.clear(true);
+    database_async.clear(true);
+  }
+
+  // ds the unused training matchables are not owned by a tree
+  for (const Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    for (const Tree::Matchable* matchable_train : matchables_train) {
+      delete matchable_train;
+    }
+  }
+}
+
+// ds minimum distance of a descriptor to all descriptors in a subtree, checking its bounds
+uint32_t checkDistanceLowerBounds(const Tree::Node* node_, const Tree::Descriptor& descriptor_) {
+  uint32_t distance_minimum = Tree::Matchable::descriptor_size_bits;
+  if (node_->hasLeafs()) {
+    distance_minimum = std::min(checkDistanceLowerBounds(node_->left, descriptor_),
+                                checkDistanceLowerBounds(node_->right, descriptor_));
+  } else {
+    for (const Tree::Matchable* matchable : node_->getMatchables()) {
+      distance_minimum = std::min(
+        distance_minimum, static_cast<uint32_t>((matchable->descriptor ^ descriptor_).count()));
+    }
+  }
+  EXPECT_LE(node_->getDistanceLowerBound(descriptor_), distance_minimum);
+  return distance_minimum;
+}
+
+TEST_F(HBST, DistanceLowerBound) {
+  number_of_bits_to_flip = 5;
+
+  // ds populate the database with both insertion paths (internal nodes summarized as well)
+  configuration.summarize_internal_nodes = true;
+  Tree database(configuration);
+  for (size_t index_image = 0; index_image < matchables_train_per_image.size(); ++index_image) {
+    if (index_image % 2 == 0) {
+      database.add(matchables_train_per_image[index_image], SplittingStrategy::SplitEven);
+    } else {
+      Tree::MatchBuffer matches;
+      database.matchAndAdd(matchables_train_per_image[index_image], matches);
+    }
+  }
+
+  // ds the summaries of every node must bound the distances to all of its descriptors
+  for (const Tree::Matchable* matchable_query : matchables_query_per_image[0]) {
+    checkDistanceLowerBounds(database.root(), matchable_query->descriptor);
+  }
+  for (const Tree::Matchable* matchable_train : matchables_train_per_image[0]) {
+    Tree::Descriptor descriptor = matchable_train->descriptor;
+    flipBits(descriptor);
+    ASSERT_LE(checkDistanceLowerBounds(database.root(), descriptor), 5u);
+  }
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST_F(HBST, SketchPrefilter) {
+  number_of_bits_to_flip = 10;
+
+  // ds populate the database
+  Tree database(configuration);
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+
+  // ds noisy queries of the first image
+  freeMatchablesQuery();
+  Tree::MatchableVector matchables_query;
+  for (const Tree::Matchable* matchable_train : matchables_train_per_image[0]) {
+    Tree::Descriptor descriptor = matchable_train->descriptor;
+    flipBits(descriptor);
+    matchables_query.emplace_back(
+      new Tree::Matchable(matchable_train->objects.begin()->second, descriptor, 10));
+  }
+  matchables_query_per_image.push_back(matchables_query);
+
+  // ds reference results without the prefilter
+  database.configuration().sketch_distance_ratio = 0;
+  Tree::MatchVector matches_reference;
+  database.match(matchables_query, matches_reference, 25);
+  Tree::MatchVectorMap matches_per_image_reference;
+  database.match(matchables_query, matches_per_image_reference, 25);
+
+  // ds the lossless prefilter must not change any result
+  database.configuration().sketch_distance_ratio = 1;
+  Tree::MatchVector matches;
+  database.match(matchables_query, matches, 25);
+  ASSERT_EQ(matches.size(), matches_reference.size());
+  for (size_t index_match = 0; index_match < matches.size(); ++index_match) {
+    ASSERT_EQ(matches[index_match].matchable_query, matches_reference[index_match].matchable_query);
+    ASSERT_EQ(matches[index_match].distance, matches_reference[index_match].distance);
+  }
+  Tree::MatchVectorMap matches_per_image;
+  database.match(matchables_query, matches_per_image, 25);
+  for (const auto& matches_image : matches_per_image_reference) {
+    ASSERT_EQ(matches_per_image[matches_image.first].size(), matches_image.second.size());
+  }
+
+  // ds a tighter prefilter trades recall for speed - correspondences within 10 bits survive
+  database.configuration().sketch_distance_ratio = 0.5;
+  matches_per_image.clear();
+  database.match(matchables_query, matches_per_image, 25);
+  size_t number_of_correct_matches = 0;
+  for (const auto& matches_image : matches_per_image_reference) {
+    ASSERT_LE(matches_per_image[matches_image.first].size(), matches_image.second.size());
+  }
+  for (const Tree::Match& match : matches_per_image[0]) {
+    if (match.object_reference == match.object_query) {
+      ++number_of_correct_matches;
+    }
+  }
+  ASSERT_GT(number_of_correct_matches, static_cast<size_t>(250));
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST_F(HBST, MatchRadius) {
+  number_of_bits_to_flip = 10;
+
+  // ds populate the database
+  Tree database(configuration);
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+
+  // ds noisy queries of the first image
+  freeMatchablesQuery();
+  Tree::MatchableVector matchables_query;
+  for (const Tree::Matchable* matchable_train : matchables_train_per_image[0]) {
+    Tree::Descriptor descriptor = matchable_train->descriptor;
+    flipBits(descriptor);
+    matchables_query.emplace_back(
+      new Tree::Matchable(matchable_train->objects.begin()->second, descriptor, 10));
+  }
+  matchables_query_per_image.push_back(matchables_query);
+  const uint32_t radius = 100;
+
+  // ds the best match of a query is always contained in its range (nearest first)
+  Tree::MatchVector matches_best;
+  database.match(matchables_query, matches_best, radius + 1);
+  Tree::RadiusMatchBuffer matches;
+  database.matchRadius(matchables_query, matches, radius);
+  ASSERT_EQ(matches.size(), matchables_query.size());
+  size_t index_match_best = 0;
+  for (size_t index_query = 0; index_query < matches.size(); ++index_query) {
+    for (const Tree::Match* match = matches.begin(index_query); match != matches.end(index_query);
+         ++match) {
+      ASSERT_EQ(match->matchable_query, matchables_query[index_query]);
+      ASSERT_LE(match->distance, radius);
+      if (match != matches.begin(index_query)) {
+        ASSERT_GE(match->distance, (match - 1)->distance);
+      }
+    }
+    if (index_match_best < matches_best.size() &&
+        matches_best[index_match_best].matchable_query == matchables_query[index_query]) {
+      ASSERT_GT(matches.numberOfMatches(index_query), static_cast<size_t>(0));
+      ASSERT_EQ(matches.begin(index_query)->distance, matches_best[index_match_best].distance);
+      ++index_match_best;
+    }
+  }
+  ASSERT_EQ(index_match_best, matches_best.size());
+
+  // ds probing across split boundaries retrieves additional neighbors (bounded by brute force)
+  Tree::RadiusMatchBuffer matches_probed;
+  database.matchRadius(matchables_query, matches_probed, radius, 1000, 4);
+  size_t number_of_matches_brute_force = 0;
+  for (size_t index_query = 0; index_query < matchables_query.size(); ++index_query) {
+    size_t number_of_references_within_radius = 0;
+    for (const Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+      for (const Tree::Matchable* matchable_train : matchables_train) {
+        if (matchable_train->distance(matchables_query[index_query]) <= radius) {
+          ++number_of_references_within_radius;
+        }
+      }
+    }
+    ASSERT_GE(matches_probed.numberOfMatches(index_query), matches.numberOfMatches(index_query));
+    ASSERT_LE(matches_probed.numberOfMatches(index_query), number_of_references_within_radius);
+    number_of_matches_brute_force += number_of_references_within_radius;
+  }
+  ASSERT_GT(matches_probed.matches.size(), matches.matches.size());
+  ASSERT_LE(matches_probed.matches.size(), number_of_matches_brute_force);
+
+  // ds without internal summaries all branches are bounded by the flipped split bit only - the
+  // shallowest branch is probed first: the destination leaf of the root's other child
+  ASSERT_FALSE(configuration.summarize_internal_nodes);
+  ASSERT_TRUE(database.root()->hasLeafs());
+  Tree::RadiusMatchBuffer matches_probed_once;
+  database.matchRadius(matchables_query, matches_probed_once, radius, 1000, 1);
+  const auto descend = [](const Tree::Node* node_, const Tree::Descriptor& descriptor_) {
+    while (node_->hasLeafs()) {
+      node_ = descriptor_[node_->indexSplitBit()] ? node_->right : node_->left;
+    }
+    return node_;
+  };
+  for (size_t index_query = 0; index_query < matchables_query.size(); ++index_query) {
+    const Tree::Descriptor& descriptor_query = matchables_query[index_query]->descriptor;
+    const Tree::Node* root                   = database.root();
+    const Tree::Node* branch = descriptor_query[root->indexSplitBit()] ? root->left : root->right;
+    ASSERT_TRUE(branch->hasLeafs());
+    size_t number_of_references_within_radius = 0;
+    for (const Tree::Node* leaf :
+         {descend(root, descriptor_query), descend(branch, descriptor_query)}) {
+      for (const Tree::Matchable* matchable_reference : leaf->getMatchables()) {
+        if (matchable_reference->distance(matchables_query[index_query]) <= radius) {
+          ++number_of_references_within_radius;
+        }
+      }
+    }
+    ASSERT_EQ(matches_probed_once.numberOfMatches(index_query), number_of_references_within_radius);
+  }
+
+  // ds the number of matches per query is capped - keeping the nearest ones
+  Tree::RadiusMatchBuffer matches_capped;
+  database.matchRadius(matchables_query, matches_capped, radius, 2, 4);
+  for (size_t index_query = 0; index_query < matches_capped.size(); ++index_query) {
+    ASSERT_EQ(matches_capped.numberOfMatches(index_query),
+              std::min(matches_probed.numberOfMatches(index_query), static_cast<size_t>(2)));
+    if (matches_capped.numberOfMatches(index_query) > 0) {
+      ASSERT_EQ(matches_capped.begin(index_query)->distance,
+                matches_probed.begin(index_query)->distance);
+    }
+  }
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST_F(HBST, MatchWithRatio) {
+  number_of_bits_to_flip = 10;
+
+  // ds populate the database
+  Tree database(configuration);
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+
+  // ds noisy queries of the first image
+  freeMatchablesQuery();
+  Tree::MatchableVector matchables_query;
+  for (const Tree::Matchable* matchable_train : matchables_train_per_image[0]) {
+    Tree::Descriptor descriptor = matchable_train->descriptor;
+    flipBits(descriptor);
+    matchables_query.emplace_back(
+      new Tree::Matchable(matchable_train->objects.begin()->second, descriptor, 10));
+  }
+  matchables_query_per_image.push_back(matchables_query);
+  const uint32_t maximum_distance = 120;
+  const double ratio              = 0.8;
+
+  // ds the range search over the same leaf yields best and second best distance of each query -
+  // the second best is considered beyond the maximum distance
+  Tree::RadiusMatchBuffer matches_leaf;
+  database.matchRadius(matchables_query, matches_leaf, Tree::Matchable::descriptor_size_bits);
+  Tree::MatchVector matches;
+  database.matchWithRatio(matchables_query, matches, maximum_distance, ratio);
+  size_t index_match = 0;
+  for (size_t index_query = 0; index_query < matchables_query.size(); ++index_query) {
+    const size_t number_of_candidates = matches_leaf.numberOfMatches(index_query);
+    const Tree::Match* candidates     = matches_leaf.begin(index_query);
+    if (number_of_candidates > 0 && candidates[0].distance < maximum_distance &&
+        (number_of_candidates == 1 || candidates[0].distance < ratio * candidates[1].distance)) {
+      ASSERT_LT(index_match, matches.size());
+      ASSERT_EQ(matches[index_match].matchable_query, matchables_query[index_query]);
+      ASSERT_EQ(matches[index_match].distance, candidates[0].distance);
+      ++index_match;
+    }
+  }
+  ASSERT_EQ(index_match, matches.size());
+  ASSERT_GT(matches.size(), static_cast<size_t>(250));
+
+  // ds per image: unambiguous matches are a subset of the best matches in each image
+  Tree::MatchVectorMap matches_per_image;
+  database.match(matchables_query, matches_per_image, maximum_distance);
+  Tree::MatchVectorMap matches_per_image_ratio;
+  database.matchWithRatio(matchables_query, matches_per_image_ratio, maximum_distance, ratio);
+  ASSERT_EQ(matches_per_image_ratio.size(), matches_per_image.size());
+  size_t number_of_rejected_matches = 0;
+  for (const auto& matches_image : matches_per_image) {
+    const Tree::MatchVector& matches_ratio = matches_per_image_ratio[matches_image.first];
+    size_t index_match_best                = 0;
+    for (const Tree::Match& match : matches_ratio) {
+      while (index_match_best < matches_image.second.size() &&
+             matches_image.second[index_match_best].matchable_query != match.matchable_query) {
+        ++index_match_best;
+      }
+      ASSERT_LT(index_match_best, matches_image.second.size());
+      ASSERT_EQ(matches_image.second[index_match_best].distance, match.distance);
+    }
+    number_of_rejected_matches += matches_image.second.size() - matches_ratio.size();
+  }
+  ASSERT_GT(number_of_rejected_matches, static_cast<size_t>(0));
+  size_t number_of_correct_matches = 0;
+  for (const Tree::Match& match : matches_per_image_ratio[0]) {
+    if (match.object_reference == match.object_query) {
+      ++number_of_correct_matches;
+    }
+  }
+  ASSERT_GT(number_of_correct_matches, static_cast<size_t>(250));
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST_F(HBST, MatchWithRatioThreshold) {
+  // ds a query with references at distances 24 (best) and 26 or 31 (second best) in one image
+  Tree::Descriptor descriptor_query;
+  Tree::Descriptor descriptor_best;
+  Tree::Descriptor descriptor_second_close;
+  Tree::Descriptor descriptor_second_far;
+  for (uint32_t index_bit = 0; index_bit < 24; ++index_bit) {
+    descriptor_best[index_bit] = 1;
+  }
+  for (uint32_t index_bit = 100; index_bit < 126; ++index_bit) {
+    descriptor_second_close[index_bit] = 1;
+  }
+  for (uint32_t index_bit = 100; index_bit < 131; ++index_bit) {
+    descriptor_second_far[index_bit] = 1;
+  }
+  const double ratio = 0.8;
+  configuration.maximum_number_of_matchables_linear_search = 0;
+  Tree::MatchableVector matchables_query(1, new Tree::Matchable(0, descriptor_query, 10));
+  const std::vector<Tree::Descriptor> descriptors_second = {descriptor_second_close,
+                                                           descriptor_second_far};
+  for (const Tree::Descriptor& descriptor_second : descriptors_second) {
+    Tree::MatchableVector matchables_reference;
+    matchables_reference.push_back(new Tree::Matchable(1, descriptor_best));
+    matchables_reference.push_back(new Tree::Matchable(2, descriptor_second));
+    Tree database(configuration);
+    database.add(matchables_reference, SplittingStrategy::SplitEven);
+
+    // ds the ratio test must not depend on the maximum distance, even if the second best lies
+    // beyond it: 24 < 0.8 * 26 fails, 24 < 0.8 * 31 passes
+    const size_t number_of_matches_expected = (descriptor_second == descriptor_second_far);
+    for (const uint32_t& maximum_distance : std::vector<uint32_t>({25, 27, 30, 50})) {
+      Tree::MatchVector matches;
+      database.matchWithRatio(matchables_query, matches, maximum_distance, ratio);
+      ASSERT_EQ(matches.size(), number_of_matches_expected);
+      Tree::MatchVectorMap matches_per_image;
+      database.matchWithRatio(matchables_query, matches_per_image, maximum_distance, ratio);
+      ASSERT_EQ(matches_per_image.at(0).size(), number_of_matches_expected);
+    }
+    database.clear(true);
+  }
+  delete matchables_query.front();
+}
+
+TEST_F(HBST, MatchMutual) {
+  number_of_bits_to_flip = 10;
+
+  // ds reference frame
+  Tree tree_reference(configuration);
+  tree_reference.add(matchables_train_per_image[0], SplittingStrategy::SplitEven);
+
+  // ds query frame: noisy observations of the reference frame (owned by the query tree)
+  Tree::MatchableVector matchables_query;
+  for (const Tree::Matchable* matchable_train : matchables_train_per_image[0]) {
+    Tree::Descriptor descriptor = matchable_train->descriptor;
+    flipBits(descriptor);
+    matchables_query.emplace_back(
+      new Tree::Matchable(matchable_train->objects.begin()->second, descriptor, 10));
+  }
+  Tree tree_query(configuration);
+  tree_query.add(matchables_query, SplittingStrategy::SplitEven);
+
+  // ds two full passes and a join over the reference matchables
+  Tree::MatchVector matches_forward;
+  tree_reference.match(matchables_query, matches_forward, 50);
+  Tree::MatchVector matches_backward;
+  tree_query.match(matchables_train_per_image[0], matches_backward, 50);
+  std::map<const Tree::Matchable*, const Tree::Matchable*> matchables_query_best;
+  for (const Tree::Match& match : matches_backward) {
+    matchables_query_best[match.matchable_query] = match.matchable_reference;
+  }
+  Tree::MatchVector matches_joined;
+  for (const Tree::Match& match : matches_forward) {
+    if (matchables_query_best[match.matchable_reference] == match.matchable_query) {
+      matches_joined.push_back(match);
+    }
+  }
+
+  // ds cross-check matching must yield identical pairs
+  Tree::MatchVector matches;
+  tree_reference.matchMutual(matchables_query, tree_query, matches, 50);
+  ASSERT_EQ(matches.size(), matches_joined.size());
+  size_t number_of_correct_matches = 0;
+  for (size_t index_match = 0; index_match < matches.size(); ++index_match) {
+    ASSERT_EQ(matches[index_match].matchable_query, matches_joined[index_match].matchable_query);
+    ASSERT_EQ(matches[index_match].matchable_reference,
+              matches_joined[index_match].matchable_reference);
+    ASSERT_EQ(matches[index_match].distance, matches_joined[index_match].distance);
+    if (matches[index_match].object_reference == matches[index_match].object_query) {
+      ++number_of_correct_matches;
+    }
+  }
+  ASSERT_LE(matches.size(), matches_forward.size());
+  ASSERT_GT(number_of_correct_matches, static_cast<size_t>(250));
+
+  // ds a query tree built by matchAndAdd (without merges) is accepted just as well
+  Tree::MatchableVector matchables_query_streamed;
+  for (const Tree::Matchable* matchable_query : matchables_query) {
+    matchables_query_streamed.emplace_back(new Tree::Matchable(
+      matchable_query->objects.begin()->second, matchable_query->descriptor, 10));
+  }
+  Tree tree_query_streamed(configuration);
+  Tree::MatchBuffer matches_streamed;
+  tree_query_streamed.matchAndAdd(matchables_query_streamed, matches_streamed);
+  ASSERT_EQ(tree_query_streamed.numberOfMatchablesUncompressed(), matchables_query.size());
+  ASSERT_EQ(tree_query_streamed.numberOfMatchablesCompressed(), matchables_query.size());
+  Tree::MatchVector matches_mutual_streamed;
+  ASSERT_NO_THROW(tree_reference.matchMutual(
+    matchables_query_streamed, tree_query_streamed, matches_mutual_streamed, 50));
+  ASSERT_EQ(matches_mutual_streamed.size(), matches.size());
+  tree_query_streamed.clear(true);
+#ifdef SRRG_MERGE_DESCRIPTORS
+
+  // ds a query tree that merged matchables is rejected (merged query matchables are freed)
+  Tree::MatchableVector matchables_duplicate(
+    1, new Tree::Matchable(0, matchables_query.front()->descriptor, 11));
+  tree_query.add(matchables_duplicate, SplittingStrategy::SplitEven);
+  ASSERT_EQ(tree_query.numberOfMergedMatchablesLastTraining(), static_cast<size_t>(1));
+  ASSERT_THROW(tree_reference.matchMutual(matchables_query, tree_query, matches, 50),
+               std::runtime_error);
+#endif
+
+  // ds clear databases
+  tree_reference.clear(true);
+  tree_query.clear(true);
+}
+
+void checkImageRanges(const Tree::Node* node_) {
+  if (node_->hasLeafs()) {
+    checkImageRanges(node_->left);
+    checkImageRanges(node_->right);
+    ASSERT_LE(node_->getIdentifierImageMinimum(), node_->left->getIdentifierImageMinimum());
+    ASSERT_LE(node_->getIdentifierImageMinimum(), node_->right->getIdentifierImageMinimum());
+    ASSERT_GE(node_->getIdentifierImageMaximum(), node_->left->getIdentifierImageMaximum());
+    ASSERT_GE(node_->getIdentifierImageMaximum(), node_->right->getIdentifierImageMaximum());
+  } else {
+    for (const Tree::Matchable* matchable : node_->getMatchables()) {
+      for (const auto& object : matchable->objects) {
+        ASSERT_LE(node_->getIdentifierImageMinimum(), object.first);
+        ASSERT_GE(node_->getIdentifierImageMaximum(), object.first);
+      }
+    }
+  }
+}
+
+TEST_F(HBST, ImageFilter) {
+  number_of_bits_to_flip = 10;
+
+  // ds populate the database with both insertion paths (internal nodes summarized as well)
+  configuration.summarize_internal_nodes = true;
+  Tree database(configuration);
+  for (size_t index_image = 0; index_image < matchables_train_per_image.size(); ++index_image) {
+    if (index_image % 2 == 0) {
+      database.add(matchables_train_per_image[index_image], SplittingStrategy::SplitEven);
+    } else {
+      Tree::MatchBuffer matches;
+      database.matchAndAdd(matchables_train_per_image[index_image], matches);
+    }
+  }
+  checkImageRanges(database.root());
+
+  // ds noisy queries of the third image
+  freeMatchablesQuery();
+  Tree::MatchableVector matchables_query;
+  for (const Tree::Matchable* matchable_train : matchables_train_per_image[2]) {
+    Tree::Descriptor descriptor = matchable_train->descriptor;
+    flipBits(descriptor);
+    matchables_query.emplace_back(
+      new Tree::Matchable(matchable_train->objects.begin()->second, descriptor, 10));
+  }
+  matchables_query_per_image.push_back(matchables_query);
+
+  // ds eligible images: 2, 3, 6 and 8
+  Tree::ImageFilter image_filter;
+  image_filter.identifier_minimum        = 2;
+  image_filter.identifier_maximum        = 8;
+  image_filter.identifier_excluded_begin = 4;
+  image_filter.identifier_excluded_end   = 6;
+  image_filter.eligible_images.resize(10, true);
+  image_filter.eligible_images[7] = false;
+
+  // ds the filtered search must yield the unfiltered matches of the eligible images only
+  Tree::MatchVectorMap matches;
+  database.match(matchables_query, matches, 50);
+  Tree::MatchVectorMap matches_filtered;
+  database.match(matchables_query, matches_filtered, 50, image_filter);
+  ASSERT_EQ(matches_filtered.size(), matches.size());
+  for (const auto& matches_image : matches) {
+    const Tree::MatchVector& matches_image_filtered = matches_filtered[matches_image.first];
+    if (image_filter.isEligible(matches_image.first)) {
+      ASSERT_EQ(matches_image_filtered.size(), matches_image.second.size());
+      for (size_t index_match = 0; index_match < matches_image_filtered.size(); ++index_match) {
+        ASSERT_EQ(matches_image_filtered[index_match].matchable_query,
+                  matches_image.second[index_match].matchable_query);
+        ASSERT_EQ(matches_image_filtered[index_match].distance,
+                  matches_image.second[index_match].distance);
+      }
+    } else {
+      ASSERT_EQ(matches_image_filtered.size(), static_cast<size_t>(0));
+    }
+  }
+  ASSERT_GT(matches_filtered[2].size(), static_cast<size_t>(250));
+
+  // ds the best reference of a query restricted to a single image is its best match in the image
+  Tree::ImageFilter image_filter_single;
+  image_filter_single.identifier_minimum = 3;
+  image_filter_single.identifier_maximum = 3;
+  Tree::MatchVector matches_single;
+  database.match(matchables_query, matches_single, 50, image_filter_single);
+  ASSERT_EQ(matches_single.size(), matches[3].size());
+  for (size_t index_match = 0; index_match < matches_single.size(); ++index_match) {
+    ASSERT_EQ(matches_single[index_match].distance, matches[3][index_match].distance);
+    ASSERT_EQ(matches_single[index_match].object_reference,
+              matches[3][index_match].object_reference);
+  }
+
+  // ds filtered image scores are the unfiltered scores of the eligible images
+  const Tree::ScoreVector scores = database.getScorePerImage(matchables_query, false, 50);
+  const Tree::ScoreVector scores_filtered =
+    database.getScorePerImage(matchables_query, false, 50, image_filter);
+  size_t index_score_filtered = 0;
+  for (const Tree::Score& score : scores) {
+    if (image_filter.isEligible(score.identifier_reference)) {
+      ASSERT_LT(index_score_filtered, scores_filtered.size());
+      ASSERT_EQ(scores_filtered[index_score_filtered].identifier_reference,
+                score.identifier_reference);
+      ASSERT_EQ(scores_filtered[index_score_filtered].number_of_matches, score.number_of_matches);
+      ++index_score_filtered;
+    }
+  }
+  ASSERT_EQ(index_score_filtered, scores_filtered.size());
+  size_t number_of_images_voted = 0;
+  for (const Tree::Score& score_filtered : scores_filtered) {
+    number_of_images_voted += (score_filtered.number_of_matches > 0);
+  }
+
+  // ds the best eligible images are retrieved with identical votes (single and multi-threaded)
+  for (const size_t number_of_threads : {1, 4}) {
+    const Tree::ScoreVector scores_top_k =
+      database.getTopKImages(matchables_query, 10, 50, number_of_threads, image_filter);
+    ASSERT_EQ(scores_top_k.size(), number_of_images_voted);
+    for (const Tree::Score& score_top_k : scores_top_k) {
+      ASSERT_TRUE(image_filter.isEligible(score_top_k.identifier_reference));
+      for (const Tree::Score& score : scores) {
+        if (score.identifier_reference == score_top_k.identifier_reference) {
+          ASSERT_EQ(score_top_k.number_of_matches, score.number_of_matches);
+        }
+      }
+    }
+  }
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST_F(HBST, MatchExact) {
+  number_of_bits_to_flip = 20;
+
+  // ds populate the database
+  Tree database(configuration);
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+
+  // ds noisy queries of the first image
+  freeMatchablesQuery();
+  Tree::MatchableVector matchables_query;
+  for (const Tree::Matchable* matchable_train : matchables_train_per_image[0]) {
+    Tree::Descriptor descriptor = matchable_train->descriptor;
+    flipBits(descriptor);
+    matchables_query.emplace_back(
+      new Tree::Matchable(matchable_train->objects.begin()->second, descriptor, 10));
+  }
+  matchables_query_per_image.push_back(matchables_query);
+  const uint32_t maximum_distance = 100;
+
+  // ds the exact search must find the brute-force nearest neighbor of every query
+  Tree::MatchVector matches_exact;
+  const size_t number_of_leafs_visited =
+    database.matchExact(matchables_query, matches_exact, maximum_distance);
+  Tree::MatchVector matches;
+  database.match(matchables_query, matches, maximum_distance);
+  size_t index_match_exact          = 0;
+  size_t index_match                = 0;
+  size_t number_of_improved_matches = 0;
+  for (const Tree::Matchable* matchable_query : matchables_query) {
+    uint32_t distance_best = maximum_distance;
+    for (const Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+      for (const Tree::Matchable* matchable_train : matchables_train) {
+        distance_best = std::min(distance_best, matchable_train->distance(matchable_query));
+      }
+    }
+    if (distance_best < maximum_distance) {
+      ASSERT_LT(index_match_exact, matches_exact.size());
+      ASSERT_EQ(matches_exact[index_match_exact].matchable_query, matchable_query);
+      ASSERT_EQ(matches_exact[index_match_exact].distance, distance_best);
+      ++index_match_exact;
+    }
+
+    // ds the single leaf descent can only be worse
+    if (index_match < matches.size() && matches[index_match].matchable_query == matchable_query) {
+      ASSERT_GE(matches[index_match].distance, distance_best);
+      if (matches[index_match].distance > distance_best) {
+        ++number_of_improved_matches;
+      }
+      ++index_match;
+    } else if (distance_best < maximum_distance) {
+      ++number_of_improved_matches;
+    }
+  }
+  ASSERT_EQ(index_match_exact, matches_exact.size());
+  ASSERT_GT(number_of_improved_matches, static_cast<size_t>(0));
+  ASSERT_GT(number_of_leafs_visited, matchables_query.size());
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST_F(HBST, LinearSearch) {
+  number_of_bits_to_flip = 20;
+
+  // ds populate the database scanned linearly
+  configuration.maximum_number_of_matchables_linear_search = std::numeric_limits<size_t>::max();
+  Tree database(configuration);
+  for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+
+  // ds noisy queries of the first image
+  freeMatchablesQuery();
+  Tree::MatchableVector matchables_query;
+  for (const Tree::Matchable* matchable_train : matchables_train_per_image[0]) {
+    Tree::Descriptor descriptor = matchable_train->descriptor;
+    flipBits(descriptor);
+    matchables_query.emplace_back(
+      new Tree::Matchable(matchable_train->objects.begin()->second, descriptor, 10));
+  }
+  matchables_query_per_image.push_back(matchables_query);
+  const uint32_t maximum_distance = 100;
+
+  // ds the linear search must find the brute-force nearest neighbor of every query
+  Tree::MatchVector matches;
+  database.match(matchables_query, matches, maximum_distance);
+  Tree::MatchVector matches_lazy;
+  database.matchLazy(matchables_query, matches_lazy, maximum_distance);
+  size_t index_match = 0;
+  for (const Tree::Matchable* matchable_query : matchables_query) {
+    uint32_t distance_best = maximum_distance;
+    for (const Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+      for (const Tree::Matchable* matchable_train : matchables_train) {
+        distance_best = std::min(distance_best, matchable_train->distance(matchable_query));
+      }
+    }
+    if (distance_best < maximum_distance) {
+      ASSERT_LT(index_match, matches.size());
+      ASSERT_EQ(matches[index_match].matchable_query, matchable_query);
+      ASSERT_EQ(matches[index_match].distance, distance_best);
+      ASSERT_EQ(matches_lazy[index_match].matchable_query, matchable_query);
+      ASSERT_GE(matches_lazy[index_match].distance, distance_best);
+      ASSERT_LT(matches_lazy[index_match].distance, maximum_distance);
+      ++index_match;
+    }
+  }
+  ASSERT_EQ(index_match, matches.size());
+  ASSERT_EQ(index_match, matches_lazy.size());
+
+  // ds every query is counted at most once per image - the first image contains all originals
+  const Tree::ScoreVector scores = database.getScorePerImage(matchables_query, true);
+  ASSERT_EQ(scores.size(), matchables_train_per_image.size());
+  ASSERT_EQ(scores.front().identifier_reference, static_cast<uint64_t>(0));
+  ASSERT_EQ(scores.front().number_of_matches, matchables_query.size());
+
+  // ds all other query paths scan the same matchables: batches, counts and top-K agree
+  Tree::MatchVector matches_batch;
+  database.matchBatch(matchables_query, matches_batch, maximum_distance);
+  Tree::MatchVector matches_lazy_batch;
+  database.matchLazyBatch(matchables_query, matches_lazy_batch, maximum_distance);
+  ASSERT_EQ(matches_batch.size(), matches.size());
+  ASSERT_EQ(matches_lazy_batch.size(), matches_lazy.size());
+  for (size_t index_match = 0; index_match < matches.size(); ++index_match) {
+    ASSERT_EQ(matches_batch[index_match].matchable_query, matches[index_match].matchable_query);
+    ASSERT_EQ(matches_batch[index_match].matchable_reference,
+              matches[index_match].matchable_reference);
+    ASSERT_EQ(matches_batch[index_match].distance, matches[index_match].distance);
+    ASSERT_EQ(matches_lazy_batch[index_match].matchable_reference,
+              matches_lazy[index_match].matchable_reference);
+  }
+  ASSERT_EQ(database.getNumberOfMatches(matchables_query, maximum_distance), matches.size());
+  const Tree::ScoreVector scores_top = database.getTopKImages(matchables_query, scores.size());
+  size_t number_of_scores_voted = 0;
+  for (const Tree::Score& score : scores) {
+    if (score.number_of_matches > 0) {
+      ASSERT_LT(number_of_scores_voted, scores_top.size());
+      ASSERT_EQ(scores_top[number_of_scores_voted].identifier_reference,
+                score.identifier_reference);
+      ASSERT_EQ(scores_top[number_of_scores_voted].number_of_matches, score.number_of_matches);
+      ++number_of_scores_voted;
+    }
+  }
+  ASSERT_EQ(number_of_scores_voted, scores_top.size());
+
+  // ds without linear search the tree is descended again (results can only be worse)
+  database.configuration().maximum_number_of_matchables_linear_search = 0;
+  Tree::MatchVector matches_tree;
+  database.match(matchables_query, matches_tree, maximum_distance);
+  ASSERT_LE(matches_tree.size(), matches.size());
+
+  // ds clear database
+  database.clear(true);
+}
+
+TEST_F(HBST, TreeConfiguration) {
+  // ds trees with different node parameters side by side: a coarse tree keeps a single leaf
+  Tree::Configuration configuration_coarse = configuration;
+  configuration_coarse.maximum_leaf_size   = std::numeric_limits<uint64_t>::max();
+  Tree database(configuration);
+  Tree database_coarse(configuration_coarse);
+  for (const Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    Tree::MatchableVector matchables_coarse;
+    for (const Tree::Matchable* matchable_train : matchables_train) {
+      matchables_coarse.emplace_back(new Tree::Matchable(matchable_train->objects.begin()->second,
+                                                         matchable_train->descriptor,
+                                                         matchable_train->objects.begin()->first));
+    }
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+    database_coarse.add(matchables_coarse, SplittingStrategy::SplitEven);
+  }
+  ASSERT_TRUE(database.root()->hasLeafs());
+  ASSERT_FALSE(database_coarse.root()->hasLeafs());
+  ASSERT_EQ(database.configuration().maximum_leaf_size, Tree::Node::maximum_leaf_size);
+
+  // ds random splitting draws from the generator of each tree - concurrently built trees with
+  // the same seed must have identical structures
+  std::vector<Tree::Descriptor> descriptors;
+  for (const Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    for (const Tree::Matchable* matchable_train : matchables_train) {
+      descriptors.push_back(matchable_train->descriptor);
+    }
+  }
+  std::vector<std::unique_ptr<Tree>> databases_random;
+  for (size_t index_tree = 0; index_tree < 4; ++index_tree) {
+    databases_random.emplace_back(new Tree(configuration));
+  }
+  std::vector<std::thread> workers;
+  for (std::unique_ptr<Tree>& database_random : databases_random) {
+    Tree* tree = database_random.get();
+    workers.emplace_back([tree, &descriptors]() {
+      for (uint64_t identifier_image = 0; identifier_image < number_of_images_train;
+           ++identifier_image) {
+        Tree::MatchableVector matchables;
+        for (size_t index_descriptor = 0; index_descriptor < number_of_matchables_per_image;
+             ++index_descriptor) {
+          matchables.emplace_back(new Tree::Matchable(
+            index_descriptor,
+            descriptors[identifier_image * number_of_matchables_per_image + index_descriptor],
+            identifier_image));
+        }
+        tree->add(matchables, SplittingStrategy::SplitRandomUniform);
+      }
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  std::function<bool(const Tree::Node*, const Tree::Node*)> isEqual =
+    [&isEqual](const Tree::Node* node_a_, const Tree::Node* node_b_) {
+      if (node_a_->hasLeafs() != node_b_->hasLeafs()) {
+        return false;
+      }
+      if (!node_a_->hasLeafs()) {
+        return node_a_->getMatchables().size() == node_b_->getMatchables().size();
+      }
+      return node_a_->indexSplitBit() == node_b_->indexSplitBit() &&
+             isEqual(node_a_->left, node_b_->left) && isEqual(node_a_->right, node_b_->right);
+    };
+  ASSERT_TRUE(databases_random.front()->root()->hasLeafs());
+  for (const std::unique_ptr<Tree>& database_random : databases_random) {
+    ASSERT_TRUE(isEqual(databases_random.front()->root(), database_random->root()));
+  }
+
+  // ds clear databases
+  for (std::unique_ptr<Tree>& database_random : databases_random) {
+    database_random->clear(true);
+  }
+  database.clear(true);
+  database_coarse.clear(true);
+}
+
+TEST_F(HBST, NodeStorage) {
+  configuration.summarize_internal_nodes = false;
+  Tree database(configuration);
+  for (const Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    database.add(matchables_train, SplittingStrategy::SplitEven);
+  }
+  ASSERT_TRUE(database.root()->hasLeafs());
+
+  // ds only leafs carry matchables and summaries - all nodes derive depth and splitting mask from
+  // the path
+  std::function<void(const Tree::Node*, const uint64_t&, const Tree::Descriptor&)> check =
+    [&check](const Tree::Node* node_, const uint64_t& depth_, const Tree::Descriptor& bit_mask_) {
+      ASSERT_EQ(node_->getDepth(), depth_);
+      ASSERT_EQ(node_->getBitMask(), bit_mask_);
+      ASSERT_NE(node_->hasLeafs(), node_->hasSummary());
+      if (node_->hasLeafs()) {
+        ASSERT_TRUE(node_->getMatchables().empty());
+        Tree::Descriptor bit_mask_leafs = bit_mask_;
+        bit_mask_leafs[node_->indexSplitBit()] = 0;
+        check(node_->left, depth_ + 1, bit_mask_leafs);
+        check(node_->right, depth_ + 1, bit_mask_leafs);
+      } else {
+        ASSERT_FALSE(node_->getMatchables().empty());
+      }
+    };
+  check(database.root(), 0, Tree::Descriptor().set());
+
+  // ds a custom splitting mask is kept in the configuration of the tree
+  Tree::Descriptor bit_mask;
+  for (uint32_t index_bit = Tree::Matchable::descriptor_size_bits / 2;
+       index_bit < Tree::Matchable::descriptor_size_bits;
+       ++index_bit) {
+    bit_mask[index_bit] = 1;
+  }
+  Tree::MatchableVector matchables_masked;
+  for (const Tree::Matchable* matchable_train : matchables_train_per_image[0]) {
+    matchables_masked.push_back(
+      new Tree::Matchable(matchable_train->objects.begin()->second, matchable_train->descriptor));
+  }
+  Tree database_masked(0, matchables_masked, bit_mask, SplittingStrategy::SplitEven, configuration);
+  ASSERT_TRUE(database_masked.root()->hasLeafs());
+  check(database_masked.root(), 0, bit_mask);
+
+  // ds nodes built without a tree keep the mask in their own configuration
+  const Tree::Node node_masked(matchables_masked, bit_mask);
+  const Tree::Node node(matchables_masked);
+  check(&node_masked, 0, bit_mask);
+  check(&node, 0, Tree::Descriptor().set());
+
+  // ds clear databases
+  database.clear(true);
+  database_masked.clear(true);
+}
+
+TEST_F(HBST, Tuner) {
+  // ds descriptor sample: training images and noisy queries of the first image
+  std::vector<std::vector<Tree::Descriptor>> descriptors_train_per_image;
+  for (const Tree::MatchableVector& matchables_train : matchables_train_per_image) {
+    std::vector<Tree::Descriptor> descriptors_train;
+    for (const Tree::Matchable* matchable_train : matchables_train) {
+      descriptors_train.push_back(matchable_train->descriptor);
+      delete matchable_train;
+    }
+    descriptors_train_per_image.push_back(descriptors_train);
+  }
+  matchables_train_per_image.clear();
+  std::vector<Tree::Descriptor> descriptors_query;
+  for (const Tree::Descriptor& descriptor_train : descriptors_train_per_image[0]) {
+    Tree::Descriptor descriptor = descriptor_train;
+    flipBits(descriptor);
+    descriptors_query.push_back(descriptor);
+  }
+
+  // ds small sweep
+  BinaryTreeTuner<Tree> tuner(descriptors_train_per_image, descriptors_query, 50);
+  tuner.maximum_leaf_sizes    = {50, 100, 1000000};
+  tuner.maximum_partitionings = {0.1, 0.45};
+  tuner.splitting_strategies  = {SplittingStrategy::SplitEven, SplittingStrategy::SplitUneven};
+  const BinaryTreeTuner<Tree>::CandidateVector candidates = tuner.tune();
+  ASSERT_EQ(candidates.size(), static_cast<size_t>(12));
+
+  // ds a single leaf is a linear scan: it must recall every query
+  size_t number_of_candidates_pareto_optimal = 0;
+  for (const BinaryTreeTuner<Tree>::Candidate& candidate : candidates) {
+    ASSERT_GE(candidate.recall, 0);
+    ASSERT_LE(candidate.recall, 1);
+    ASSERT_GT(candidate.memory_bytes, static_cast<size_t>(0));
+    if (candidate.configuration.maximum_leaf_size == 1000000) {
+      ASSERT_EQ(candidate.recall, 1);
+    }
+    if (candidate.is_pareto_optimal) {
+      ++number_of_candidates_pareto_optimal;
+    }
+  }
+  ASSERT_GT(number_of_candidates_pareto_optimal, static_cast<size_t>(0));
+
+  // ds the recommendation is Pareto optimal and reported
+  tuner.minimum_recall = 0;
+  const BinaryTreeTuner<Tree>::Candidate candidate_recommended =
+    tuner.getRecommendedCandidate(candidates);
+  ASSERT_TRUE(candidate_recommended.is_pareto_optimal);
+  std::ostringstream report;
+  tuner.writeReport(report, candidates);
+  ASSERT_NE(report.str().find("recommended"), std::string::npos);
+}
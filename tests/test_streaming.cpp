@@ -12,7 +12,7 @@ int main(int argc_, char** argv_) {
 
 TEST_F(HBST, Write) {
   // ds populate the database
-  Tree database;
+  Tree database(configuration);
   for (Tree::MatchableVector& matchables_train : matchables_train_per_image) {
     database.add(matchables_train, SplittingStrategy::SplitEven);
   }
@@ -30,8 +30,8 @@ TEST_F(HBST, Write) {
       // ds check match against hardcoded sampling ground truth
       const Tree::Match& match = match_vectors.at(0)[i];
       ASSERT_EQ(match.object_query, identifiers_query[i]);
-      ASSERT_GE(match.object_references.size(), static_cast<size_t>(1));
-      ASSERT_EQ(match.object_references[0], identifiers_train[i]);
+      ASSERT_GE(match.number_of_references, static_cast<uint32_t>(1));
+      ASSERT_EQ(match.object_reference, identifiers_train[i]);
       ASSERT_EQ(match.distance, matching_distances[i]);
     }
   }
@@ -45,7 +45,7 @@ TEST_F(HBST, Write) {
 
 TEST_F(HBST, Read) {
   // ds load database from disk
-  Tree database;
+  Tree database(configuration);
   ASSERT_EQ(database.size(), static_cast<size_t>(0));
   ASSERT_TRUE(database.read("database.hbst"));
   ASSERT_EQ(database.size(), static_cast<size_t>(10));
@@ -62,12 +62,23 @@ TEST_F(HBST, Read) {
       // ds check match against hardcoded sampling ground truth
       const Tree::Match& match = match_vectors.at(0)[i];
       ASSERT_EQ(match.object_query, identifiers_query[i]);
-      ASSERT_GE(match.object_references.size(), static_cast<size_t>(1));
-      ASSERT_EQ(match.object_references[0], identifiers_train[i]);
+      ASSERT_GE(match.number_of_references, static_cast<uint32_t>(1));
+      ASSERT_EQ(match.object_reference, identifiers_train[i]);
       ASSERT_EQ(match.distance, matching_distances[i]);
     }
   }
 
-  // ds clear database
+  // ds internal nodes are summarized on loading only if configured
+  ASSERT_TRUE(database.root()->hasLeafs());
+  ASSERT_FALSE(database.root()->hasSummary());
+  configuration.summarize_internal_nodes = true;
+  Tree database_summarized(configuration);
+  ASSERT_TRUE(database_summarized.read("database.hbst"));
+  ASSERT_TRUE(database_summarized.root()->hasSummary());
+  ASSERT_EQ(database_summarized.root()->getIdentifierImageMinimum(), static_cast<uint64_t>(0));
+  ASSERT_EQ(database_summarized.root()->getIdentifierImageMaximum(), static_cast<uint64_t>(9));
+
+  // ds clear databases
   database.clear(true);
+  database_summarized.clear(true);
 }